@@ -5,19 +5,24 @@
 #include <eosio/singleton.hpp>
 #include <eosio/system.hpp>
 #include <eosio/time.hpp>
+#include <eosio/binary_extension.hpp>
+#include <otcconf/otcconf_states.hpp>
 
 #include <deque>
 #include <optional>
 #include <string>
 #include <map>
 #include <set>
+#include <limits>
 #include <type_traits>
+#include <variant>
 
 namespace metabalance {
 
 using namespace std;
 
 using namespace eosio;
+namespace flat = wasm::flat;
 
 #define SYMBOL(sym_code, precision) symbol(symbol_code(sym_code), precision)
 
@@ -35,12 +40,30 @@ static constexpr eosio::name MT_BANK{"amax.mtoken"_n};
 static uint64_t percent_boost     = 10000;
 static constexpr uint64_t order_stake_pct   = 10000; // 100%
 static constexpr uint64_t max_memo_size     = 256;
+static constexpr uint64_t max_close_msg_size = 64;
 
 static constexpr uint64_t seconds_per_day                   = 24 * 3600;
 static constexpr uint64_t seconds_per_year                  = 365 * seconds_per_day;
 static constexpr uint64_t max_blacklist_duration_second     = 100 * seconds_per_year; // 100 year
 static constexpr uint64_t deal_expired_second               = 30 * 60;
 
+// price key of orders which can not be taken, sorted to the end of price index
+static constexpr uint64_t untakeable_price_key              = std::numeric_limits<uint64_t>::max();
+static constexpr uint64_t max_take_best_orders              = 20;   // max orders taken by one takebest()
+static constexpr uint64_t max_take_best_scan                = 200;  // max orders scanned by one takebest(), skipped ones included
+static constexpr uint64_t deal_id_mask                      = (1ULL << 56) - 1;   // deal id bits in participant index keys
+static constexpr uint64_t buy_depth_flag                    = 1ULL << 63;   // key flag of buy levels in depth
+static constexpr uint32_t max_blacklist_lazy_purge          = 2;    // max expired blacklist rows erased by a deal action
+static constexpr uint32_t max_settle_queue_lazy_purge       = 2;    // max drained settle queue rows erased by a deal close
+
+// order and deal ids of market: market id << market_id_shift | serial, kept within deal_id_mask
+static constexpr uint64_t default_market_id                 = 0;    // market of conf fiat_type, scope: contract
+static constexpr uint64_t market_id_shift                   = 48;
+static constexpr uint64_t max_market_id                     = (1ULL << (56 - market_id_shift)) - 1;
+static constexpr uint64_t max_market_serial                 = (1ULL << market_id_shift) - 1;
+
+inline uint64_t market_of(const uint64_t& id) { return id >> market_id_shift; }
+
 constexpr eosio::name MBANK                     = "amax.mtoken"_n;
 
 
@@ -77,6 +100,51 @@ struct [[eosio::table("global"), eosio::contract("otcbook")]] global_t {
 };
 typedef eosio::singleton< "global"_n, global_t > global_singleton;
 
+/**
+ * settings added after global_t, kept apart so that the existing global row still decodes
+ */
+struct [[eosio::table("global2"), eosio::contract("otcbook")]] global2_t {
+    uint32_t deal_retention_sec = 30 * 24 * 3600;   // closed or cancelled deals older than it can be pruned, 0: never
+    uint32_t max_open_orders    = 0;                // max open orders of a merchant, 0: no limit
+    uint32_t fee_flush_interval_sec = 24 * 3600;    // accrued fees are transferred to split contract at most this late, 0: no interval
+    bool     settle_async       = false;            // queue closed deals for settle::drain instead of settling inline
+    uint64_t settle_queue_id    = 0;                // id of the last queued settle record
+
+    EOSLIB_SERIALIZE( global2_t, (deal_retention_sec)(max_open_orders)(fee_flush_interval_sec)
+                                 (settle_async)(settle_queue_id) )
+};
+typedef eosio::singleton< "global2"_n, global2_t > global2_singleton;
+
+/**
+ * config digest pushed by conf_contract, see otcconf::setsubscribe
+ * it is reloaded from conf_contract once version mismatches the conf version there
+ */
+struct [[eosio::table("confdigest"), eosio::contract("otcbook")]] conf_digest_tbl_t {
+    otc::conf_digest_t conf;
+    binary_extension<uint64_t> version;     // conf version of the digest
+
+    conf_digest_tbl_t() {}
+    conf_digest_tbl_t(const otc::conf_digest_t& c, const uint64_t& v): conf(c) { version.emplace(v); }
+
+    EOSLIB_SERIALIZE( conf_digest_tbl_t, (conf)(version) )
+};
+typedef eosio::singleton< "confdigest"_n, conf_digest_tbl_t > conf_digest_singleton;
+
+/**
+ * hot conf pushed by conf_contract, read on every trade, see otcconf::setsubscribe
+ * it is reloaded from conf_contract once version mismatches the hot conf version there
+ */
+struct [[eosio::table("confhot"), eosio::contract("otcbook")]] conf_hot_tbl_t {
+    otc::fiat_conf_hot_t conf;
+    uint64_t version = 0;                   // hot conf version of the conf
+
+    conf_hot_tbl_t() {}
+    conf_hot_tbl_t(const otc::fiat_conf_hot_t& c, const uint64_t& v): conf(c), version(v) {}
+
+    EOSLIB_SERIALIZE( conf_hot_tbl_t, (conf)(version) )
+};
+typedef eosio::singleton< "confhot"_n, conf_hot_tbl_t > conf_hot_singleton;
+
 enum class account_type_t: uint8_t {
     NONE           = 0,
     ADMIN          = 1,
@@ -100,6 +168,38 @@ enum class deal_action_t: uint8_t {
     CANCEL_ARBIT        = 23
 };
 
+// notifications an account receives, see otcbook::setnotify
+enum class notify_flag_t: uint8_t {
+    DEAL_INFO       = 1,    // dealnotifyv2, with app info
+    DEAL_EVENT      = 2,    // dealevent, compact
+    STAKE_CHANGED   = 4,    // stakechanged
+};
+static constexpr uint8_t default_notify_flags = (uint8_t)notify_flag_t::DEAL_INFO | (uint8_t)notify_flag_t::STAKE_CHANGED;
+
+/**
+ * compact deal event, fixed size
+ */
+struct deal_event_t {
+    uint64_t deal_id        = 0;
+    uint64_t order_id       = 0;
+    name     order_side;
+    name     merchant;
+    name     taker;
+    uint8_t  action_type    = 0;
+    uint8_t  status         = 0;
+    uint8_t  arbit_status   = 0;
+    asset    quant;
+
+    deal_event_t() {}
+    deal_event_t(const uint8_t& action, const otc::deal_change_info& info):
+        deal_id(info.deal_id), order_id(info.order_id), order_side(info.order_side),
+        merchant(info.merchant), taker(info.taker), action_type(action),
+        status(info.status), arbit_status(info.arbit_status), quant(info.quant) {}
+
+    EOSLIB_SERIALIZE(deal_event_t, (deal_id)(order_id)(order_side)(merchant)(taker)
+                                    (action_type)(status)(arbit_status)(quant) )
+};
+
 
 enum class order_status_t: uint8_t {
     NONE                = 0,
@@ -169,7 +269,7 @@ struct OTCBOOK_TBL merchant_t {
     string email;                   // email
     string memo;                    // memo
     uint8_t status;                  // status, merchant_status_t
-    map<symbol, asset_stake> assets;
+    flat::map<symbol, asset_stake> assets;
     time_point_sec updated_at;
 
     merchant_t() {}
@@ -190,6 +290,67 @@ struct OTCBOOK_TBL merchant_t {
 };
 
 ///Scope: _self.v
+struct merchant_asset_stat {
+    int64_t frozen      = 0;        // va quantity frozen by running deals
+    int64_t fulfilled   = 0;        // lifetime va quantity fulfilled
+};
+
+/**
+ * aggregates of merchant, updated with orders and deals
+ */
+struct OTCBOOK_TBL merchant_stats_t {
+    name owner;                                 // PK
+    uint32_t open_order_count   = 0;            // orders not closed
+    uint32_t running_deal_count = 0;            // deals not closed or cancelled
+    flat::map<symbol, merchant_asset_stat> assets;  // va quantity stats by coin
+
+    merchant_stats_t() {}
+    merchant_stats_t(const name& o): owner(o) {}
+
+    uint64_t primary_key() const { return owner.value; }
+
+    typedef eosio::multi_index<"merchstats"_n, merchant_stats_t> idx_t;
+
+    EOSLIB_SERIALIZE(merchant_stats_t, (owner)(open_order_count)(running_deal_count)(assets) )
+};
+
+/**
+ * deal fees not transferred to token split contract yet, by symbol
+ */
+struct OTCBOOK_TBL fee_ledger_t {
+    asset accrued;                  // PK: symbol code, fees accrued since last flush
+    asset threshold;                // flush once accrued reaches it, 0: by interval or flushfee() only
+    time_point_sec flushed_at;      // last flush time
+
+    fee_ledger_t() {}
+    fee_ledger_t(const symbol& sym): accrued(0, sym), threshold(0, sym) {}
+
+    uint64_t primary_key() const { return accrued.symbol.code().raw(); }
+
+    typedef eosio::multi_index<"feeledger"_n, fee_ledger_t> idx_t;
+
+    EOSLIB_SERIALIZE(fee_ledger_t, (accrued)(threshold)(flushed_at) )
+};
+
+/**
+ * notification preference of account, default_notify_flags if not set
+ */
+struct OTCBOOK_TBL notify_pref_t {
+    name account;                   // PK
+    uint8_t flags = default_notify_flags;   // bits of notify_flag_t
+
+    notify_pref_t() {}
+    notify_pref_t(const name& a): account(a) {}
+
+    uint64_t primary_key() const { return account.value; }
+
+    bool has(const notify_flag_t& flag) const { return flags & (uint8_t)flag; }
+
+    typedef eosio::multi_index<"notifyprefs"_n, notify_pref_t> idx_t;
+
+    EOSLIB_SERIALIZE(notify_pref_t, (account)(flags) )
+};
+
 struct OTCBOOK_TBL admin_t {
     name account;
 
@@ -214,7 +375,7 @@ struct OTCBOOK_TBL order_t {
 
     name owner;                                     // order maker's account, merchant
     string merchant_name;
-    set<name> accepted_payments;                    // accepted payments
+    flat::set<name> accepted_payments;              // accepted payments
     asset va_price;                                 // va(virtual asset) quantity price, quote in fiat, see fiat_type
     asset va_quantity;                              // va(virtual asset) quantity, see conf.coin_type
     asset va_min_take_quantity;                     // va(virtual asset) min take quantity quantity for taker, symbol must equal to quantity's
@@ -240,6 +401,11 @@ struct OTCBOOK_TBL order_t {
         return (order_status_t)status == order_status_t::RUNNING && va_quantity >= va_frozen_quantity + va_fulfilled_quantity + va_min_take_quantity;
     }
 
+    // quantity counted in depth
+    asset takeable_quantity() const {
+        return can_be_taken() ? va_quantity - va_frozen_quantity - va_fulfilled_quantity : asset(0, va_quantity.symbol);
+    }
+
     // sort by order maker account + status(is closed) + id
     // owner: lower first
     // status: closed=true in first(=0), not can_be_book in second(=1), others in third(=2)
@@ -254,6 +420,23 @@ struct OTCBOOK_TBL order_t {
         return (uint64_t) updated_at.utc_seconds ;
     }
 
+    // sort sell orders by price + id, only for orders can be taken
+    // price: lower first, orders can not be taken are in the end
+    // id: lower first
+    // the best sell order is the first one unless its price key is untakeable_price_key
+    uint128_t by_price() const {
+        uint64_t price_key = can_be_taken() ? (uint64_t)va_price.amount : untakeable_price_key;
+        return (uint128_t)price_key << 64 | id;
+    }
+
+    // sort buy orders by inverted price + id, only for orders can be taken
+    // price: higher first, orders can not be taken are in the end
+    // id: lower first
+    uint128_t by_invprice() const {
+        uint64_t price_key = can_be_taken() ? untakeable_price_key - (uint64_t)va_price.amount : untakeable_price_key;
+        return (uint128_t)price_key << 64 | id;
+    }
+
     EOSLIB_SERIALIZE(order_t,   (id)(owner)(merchant_name)(accepted_payments)(va_price)(va_quantity)
                                 (va_min_take_quantity)(va_max_take_quantity)(va_frozen_quantity)(va_fulfilled_quantity)
                                 (stake_frozen)
@@ -262,123 +445,367 @@ struct OTCBOOK_TBL order_t {
 
 /**
  * buyorders table
- * index 2: by_invprice
+ * index 2: by_update_time
  * index 3: by_maker_status
+ * index 4: by_invprice
  */
 typedef eosio::multi_index
 < "buyorders"_n,  order_t,
     indexed_by<"updatedat"_n, const_mem_fun<order_t, uint64_t, &order_t::by_update_time> >,
-    indexed_by<"maker"_n, const_mem_fun<order_t, uint128_t, &order_t::by_maker_status> >
+    indexed_by<"maker"_n, const_mem_fun<order_t, uint128_t, &order_t::by_maker_status> >,
+    indexed_by<"price"_n, const_mem_fun<order_t, uint128_t, &order_t::by_invprice> >
 > buy_order_table_t;
 
 /**
- * buyorders table
- * index 2: by_price
+ * sellorders table
+ * index 2: by_update_time
  * index 3: by_maker_status
+ * index 4: by_price
  */
 typedef eosio::multi_index
 < "sellorders"_n, order_t,
     indexed_by<"updatedat"_n, const_mem_fun<order_t, uint64_t, &order_t::by_update_time> >,
-    indexed_by<"maker"_n, const_mem_fun<order_t, uint128_t, &order_t::by_maker_status> >
+    indexed_by<"maker"_n, const_mem_fun<order_t, uint128_t, &order_t::by_maker_status> >,
+    indexed_by<"price"_n, const_mem_fun<order_t, uint128_t, &order_t::by_price> >
 > sell_order_table_t;
 
+/**
+ * buyorders/sellorders tables without price index
+ * only used to migrate the orders created before price index added
+ */
+typedef eosio::multi_index
+< "buyorders"_n,  order_t,
+    indexed_by<"updatedat"_n, const_mem_fun<order_t, uint64_t, &order_t::by_update_time> >,
+    indexed_by<"maker"_n, const_mem_fun<order_t, uint128_t, &order_t::by_maker_status> >
+> legacy_buy_order_table_t;
+
+typedef eosio::multi_index
+< "sellorders"_n, order_t,
+    indexed_by<"updatedat"_n, const_mem_fun<order_t, uint64_t, &order_t::by_update_time> >,
+    indexed_by<"maker"_n, const_mem_fun<order_t, uint128_t, &order_t::by_maker_status> >
+> legacy_sell_order_table_t;
+
+
+/**
+ * order accessor of one side, the order table type is chosen at compile time
+ */
+template<typename table_t>
+struct order_accessor_t {
+    order_accessor_t(eosio::name code, uint64_t scope, uint64_t pk): _table(code, scope), _itr(_table.find(pk)) {}
+
+    bool exists() const { return _itr != _table.end(); }
+
+    const order_t& get_order() const { return *_itr; }
 
+    template<typename Lambda>
+    void modify(eosio::name payer, Lambda&& updater) {
+        _table.modify(_itr, payer, std::forward<Lambda>(updater));
+    }
+
+    void erase() {
+        _itr = _table.erase(_itr);
+    }
+
+private:
+    table_t _table;
+    typename table_t::const_iterator _itr;
+};
+
+typedef order_accessor_t<buy_order_table_t> buy_order_accessor_t;
+typedef order_accessor_t<sell_order_table_t> sell_order_accessor_t;
+
+/**
+ * order of buy or sell side, holds the accessor of the side in place
+ * no heap allocation or virtual call, the side is dispatched once per call
+ */
 struct order_wrapper_t {
-    typedef std::function<void(order_t&)> updater_t;
-    virtual ~order_wrapper_t() {}
-    virtual const order_t& get_order() const = 0;
-    virtual void modify(eosio::name payer, const updater_t& updater) = 0;
+private:
+    eosio::name _side;
+    // the accessor is not movable since its iterator refers to its table, so it is emplaced after monostate
+    std::variant<std::monostate, buy_order_accessor_t, sell_order_accessor_t> _accessor;
+
+    template<typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) const {
+        if (auto buy_accessor = std::get_if<buy_order_accessor_t>(&_accessor))
+            return visitor(*buy_accessor);
+        return visitor(*std::get_if<sell_order_accessor_t>(&_accessor));   // always emplaced by the constructor
+    }
+
+    template<typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) {
+        if (auto buy_accessor = std::get_if<buy_order_accessor_t>(&_accessor))
+            return visitor(*buy_accessor);
+        return visitor(*std::get_if<sell_order_accessor_t>(&_accessor));   // always emplaced by the constructor
+    }
+
+public:
+    order_wrapper_t(eosio::name side, eosio::name code, uint64_t scope, uint64_t pk): _side(side) {
+        if (side == BUY_SIDE)
+            _accessor.emplace<buy_order_accessor_t>(code, scope, pk);
+        else
+            _accessor.emplace<sell_order_accessor_t>(code, scope, pk);
+    }
+
+    const eosio::name& side() const { return _side; }
+
+    bool exists() const {
+        return visit([](const auto& accessor) { return accessor.exists(); });
+    }
+
+    const order_t& get_order() const {
+        return visit([](const auto& accessor) -> const order_t& { return accessor.get_order(); });
+    }
+
+    template<typename Lambda>
+    void modify(eosio::name payer, Lambda&& updater) {
+        visit([&](auto& accessor) { accessor.modify(payer, updater); });
+    }
+
+    void erase() {
+        visit([](auto& accessor) { accessor.erase(); });
+    }
 };
 
-buy_order_table_t::const_iterator *tttt;
 
-template<typename table_t>
-struct order_wrapper_impl_t: public order_wrapper_t {
+/**
+ * market of a fiat and a coin other than the default market, its orders and deals are scoped by market id
+ */
+struct OTCBOOK_TBL market_t {
+    uint64_t id;                    // PK: 1 ~ max_market_id
+    symbol fiat;                    // price symbol
+    symbol coin;                    // va quantity symbol
+    bool enabled = true;            // orders and deals can be opened
+    flat::set<name> order_sides;    // sides of orders allowed, instead of buy/sell coins of conf
+    flat::set<name> pay_types;      // pay types allowed, instead of pay_type of conf
+    uint64_t buy_order_id = 0;      // serial of the last buy order
+    uint64_t sell_order_id = 0;     // serial of the last sell order
+    uint64_t deal_id = 0;           // serial of the last deal
+
+    market_t() {}
+    market_t(const uint64_t& i): id(i) {}
 
-    virtual const order_t& get_order() const override {
-        return *_row_ptr;
+    uint64_t primary_key() const { return id; }
+    uint64_t scope() const { return 0; }
+
+    static uint128_t make_key(const symbol& fiat, const symbol& coin) {
+        return (uint128_t)fiat.code().raw() << 64 | (uint128_t)coin.code().raw();
     }
+    uint128_t by_symbols() const { return make_key(fiat, coin); }
 
-    void modify(eosio::name payer, const updater_t& updater) override {
-        _table->modify(*_row_ptr, payer, updater);
+    typedef eosio::multi_index<"markets"_n, market_t,
+        indexed_by<"symbols"_n, const_mem_fun<market_t, uint128_t, &market_t::by_symbols> >
+    > idx_t;
+
+    EOSLIB_SERIALIZE(market_t, (id)(fiat)(coin)(enabled)(order_sides)(pay_types)(buy_order_id)(sell_order_id)(deal_id) )
+};
+
+/**
+ * takeable quantity of orders at a price level, scope: market id << 56 | coin symbol code
+ * sell levels are sorted by price first, buy levels follow, so best sell is the first and best buy is the last
+ */
+struct OTCBOOK_TBL depth_t {
+    uint64_t key = 0;               // PK: buy_depth_flag for buy side | price amount
+    name side;                      // order side, buy | sell
+    asset price;                    // price of level
+    asset quantity;                 // takeable quantity at price
+    uint64_t order_count = 0;       // count of takeable orders at price
+
+    uint64_t primary_key() const { return key; }
+
+    static uint64_t make_scope(const uint64_t& market_id, const symbol& coin) {
+        return market_id << 56 | coin.code().raw();
     }
 
-    static std::shared_ptr<order_wrapper_t> get_from_db(name code, uint64_t scope, uint64_t pk) {
-        auto ret = std::make_shared<order_wrapper_impl_t<table_t>>();
-        ret->_table = make_unique<table_t>(code, scope);
-        auto itr = ret->_table->find(pk);
-        if (itr != ret->_table->end()) {
-            ret->_row_ptr = &(*itr);
-            return ret;
-        } else {
-            return nullptr;
-        }
+    static uint64_t make_key(const name& side, const asset& price) {
+        return (side == BUY_SIDE ? buy_depth_flag : 0) | (uint64_t)price.amount;
     }
 
-private:
-    typedef typename table_t::const_iterator const_iterator;
-    std::unique_ptr<table_t> _table;
-    const order_t *_row_ptr;
+    typedef eosio::multi_index<"depth"_n, depth_t> idx_t;
+
+    EOSLIB_SERIALIZE(depth_t, (key)(side)(price)(quantity)(order_count) )
 };
 
-typedef order_wrapper_impl_t<buy_order_table_t> buy_order_wrapper_t;
-typedef order_wrapper_impl_t<sell_order_table_t> sell_order_wrapper_t;
+/**
+ * best level of each side, scope: same as depth
+ */
+struct OTCBOOK_TBL book_top_t {
+    name side;                      // PK: order side, buy | sell
+    asset price;                    // best price
+    asset quantity;                 // takeable quantity at best price
+    uint64_t order_count = 0;       // count of takeable orders at best price
+
+    uint64_t primary_key() const { return side.value; }
+
+    typedef eosio::multi_index<"booktop"_n, book_top_t> idx_t;
 
+    EOSLIB_SERIALIZE(book_top_t, (side)(price)(quantity)(order_count) )
+};
+
+/**
+ * buy/sell deal of earlier versions, moved to deal_t by otcbook::migratedeal or on first access
+ */
+struct OTCBOOK_TBL legacy_deal_t {
+    uint64_t id = 0;
+    name order_side;
+    uint64_t order_id = 0;
+    asset order_price;
+    asset deal_quantity;
+    name order_maker;
+    string merchant_name;
+    name order_taker;
+    asset deal_fee;
+    asset fine_amount;
+    name pay_type;
+    uint8_t status = 0;
+    uint8_t arbit_status = 0;
+    name arbiter;
+
+    time_point_sec created_at;
+    time_point_sec closed_at;
+    time_point_sec updated_at;
+    uint64_t order_sn = 0;
+
+    time_point_sec merchant_accepted_at;
+    time_point_sec merchant_paid_at;
+    string close_msg;
+
+    uint64_t primary_key() const { return id; }
+
+    uint128_t by_order()     const { return (uint128_t)order_id << 64 | status; }
+    uint64_t by_ordersn()    const { return order_sn;}
+    uint64_t by_update_time() const {
+        return (uint64_t) updated_at.utc_seconds ;
+    }
+    typedef eosio::multi_index
+    <"deals"_n, legacy_deal_t,
+        indexed_by<"updatedat"_n, const_mem_fun<legacy_deal_t, uint64_t, &legacy_deal_t::by_update_time> >,
+        indexed_by<"order"_n,   const_mem_fun<legacy_deal_t, uint128_t, &legacy_deal_t::by_order> >,
+        indexed_by<"ordersn"_n, const_mem_fun<legacy_deal_t, uint64_t, &legacy_deal_t::by_ordersn> >
+    > idx_t;
+
+    EOSLIB_SERIALIZE(legacy_deal_t, (id)(order_side)(order_id)(order_price)(deal_quantity)
+                                (order_maker)(merchant_name)
+                                (order_taker)(deal_fee)(fine_amount)(pay_type)
+                                (status)(arbit_status)(arbiter)
+                                (created_at)(closed_at)(updated_at)(order_sn)
+                                (merchant_accepted_at)(merchant_paid_at)
+                                (close_msg))
+};
 
 /**
  * buy/sell deal
- *
+ * amounts are stored without symbol: price is in fiat of the market, see _market_scope(),
+ * quantity in coin_symbol and fee in stake coin of coin_symbol, see fiat_conf_hot_t::stake_coin()
+ * merchant name is not copied, find it in merchants by order_maker
  */
 struct OTCBOOK_TBL deal_t {
     uint64_t id = 0;                // PK: available_primary_key, auto increase
-    name order_side;                // order side, buy(1) or sell(2)
     uint64_t order_id = 0;          // order id, created by maker by openorder()
-    asset order_price;              // order price, deal price
-    asset deal_quantity;            // deal quantity
+    symbol coin_symbol;             // symbol of quantity
+    int64_t price = 0;              // order price, deal price
+    int64_t quantity = 0;           // deal quantity
+    int64_t fee = 0;                // deal fee
     name order_maker;               // maker, merchant
-    string merchant_name;           // merchant's name
     name order_taker;               // taker, user
-    asset deal_fee;                 // deal fee
-    asset fine_amount;              // aarbit fine amount, not contain fee
     name pay_type;
-    uint8_t status = 0;             // status
-    uint8_t arbit_status = 0;       // arbit status
     name arbiter;
-
-    time_point_sec created_at;      // create time at
-    time_point_sec closed_at;       // closed time at
-    time_point_sec updated_at;
+    uint8_t flags = 0;              // bit 0~3: status, bit 4~6: arbit status, bit 7: sell side
     uint64_t order_sn = 0;          // order sn, created by external app
 
-    time_point_sec merchant_accepted_at;  // merchant accepted time
-    time_point_sec merchant_paid_at;      // merchant paid time
-    string close_msg;
+    time_point_sec created_at;      // create time at
+    time_point_sec updated_at;      // closed time at for closed and cancelled deals, they are not updated any more
+    unsigned_int accepted_after;    // merchant accepted time, seconds after created_at + 1, 0 if not accepted
+    unsigned_int paid_after;        // merchant paid time, seconds after created_at + 1, 0 if not paid
+    string close_msg;               // truncated to max_close_msg_size
 
     deal_t() {}
     deal_t(uint64_t i): id(i) {}
+    deal_t(const legacy_deal_t& d):
+        id(d.id), order_id(d.order_id), coin_symbol(d.deal_quantity.symbol),
+        price(d.order_price.amount), quantity(d.deal_quantity.amount), fee(d.deal_fee.amount),
+        order_maker(d.order_maker), order_taker(d.order_taker), pay_type(d.pay_type), arbiter(d.arbiter),
+        order_sn(d.order_sn), created_at(d.created_at), updated_at(d.updated_at),
+        close_msg(d.close_msg.substr(0, max_close_msg_size)) {
+        set_status(d.status);
+        set_arbit_status(d.arbit_status);
+        set_order_side(d.order_side);
+        set_merchant_accepted_at(d.merchant_accepted_at);
+        set_merchant_paid_at(d.merchant_paid_at);
+        // fine_amount was never charged, arbit fines are paid from the order stakes
+    }
+
+    uint8_t status()        const { return flags & 0x0F; }
+    uint8_t arbit_status()  const { return flags >> 4 & 0x07; }
+    name order_side()       const { return flags & 0x80 ? SELL_SIDE : BUY_SIDE; }
+    void set_status(const uint8_t& s)       { flags = (flags & 0xF0) | (s & 0x0F); }
+    void set_arbit_status(const uint8_t& s) { flags = (flags & 0x8F) | (s & 0x07) << 4; }
+    void set_order_side(const name& side)   { flags = side == SELL_SIDE ? flags | 0x80 : flags & 0x7F; }
+
+    bool is_terminal() const {
+        auto s = (deal_status_t)status();
+        return s == deal_status_t::CLOSED || s == deal_status_t::CANCELLED;
+    }
+    time_point_sec closed_at()            const { return is_terminal() ? updated_at : time_point_sec(); }
+    time_point_sec merchant_accepted_at() const { return _time_after(accepted_after); }
+    time_point_sec merchant_paid_at()     const { return _time_after(paid_after); }
+    void set_merchant_accepted_at(const time_point_sec& t) { accepted_after = _after(t); }
+    void set_merchant_paid_at(const time_point_sec& t)     { paid_after = _after(t); }
+
+    asset order_price(const symbol& fiat)   const { return asset(price, fiat); }
+    asset deal_quantity()                   const { return asset(quantity, coin_symbol); }
+    asset deal_fee(const symbol& stake)     const { return asset(fee, stake); }
 
     uint64_t primary_key() const { return id; }
     uint64_t scope() const { return /*order_price.symbol.code().raw()*/ 0; }
 
-    uint128_t by_order()     const { return (uint128_t)order_id << 64 | status; }
+    uint128_t by_order()     const { return (uint128_t)order_id << 64 | status(); }
     uint64_t by_ordersn()    const { return order_sn;}
     uint64_t by_update_time() const {
         return (uint64_t) updated_at.utc_seconds ;
     }
+    // closing time of terminal deals, other deals are sorted to the end
+    uint64_t by_close_time() const {
+        if (!is_terminal())
+            return std::numeric_limits<uint64_t>::max();
+        return by_update_time();
+    }
+    // time the accepted_timeout of conf counts from, deals which can not time out are sorted to the end
+    uint64_t by_deadline() const {
+        if (arbit_status() != (uint8_t)arbit_status_t::UNARBITTED && arbit_status() != (uint8_t)arbit_status_t::NONE)
+            return std::numeric_limits<uint64_t>::max();
+        switch ((deal_status_t)status()) {
+            case deal_status_t::CREATED:        return created_at.utc_seconds;
+            case deal_status_t::MAKER_ACCEPTED: return merchant_accepted_at().utc_seconds;
+            default:                            return std::numeric_limits<uint64_t>::max();
+        }
+    }
+    // participant + status + id, id takes the low 56 bits
+    uint128_t by_taker()   const { return (uint128_t)order_taker.value << 64 | (uint128_t)status() << 56 | (id & deal_id_mask); }
+    uint128_t by_arbiter() const { return (uint128_t)arbiter.value << 64 | (uint128_t)arbit_status() << 56 | (id & deal_id_mask); }
     typedef eosio::multi_index
-    <"deals"_n, deal_t,
-        indexed_by<"updatedat"_n, const_mem_fun<deal_t, uint64_t, &deal_t::by_update_time> >,
+    <"dealsv2"_n, deal_t,
+        indexed_by<"closedat"_n, const_mem_fun<deal_t, uint64_t, &deal_t::by_close_time> >,
         indexed_by<"order"_n,   const_mem_fun<deal_t, uint128_t, &deal_t::by_order> >,
-        indexed_by<"ordersn"_n, const_mem_fun<deal_t, uint64_t, &deal_t::by_ordersn> >
+        indexed_by<"ordersn"_n, const_mem_fun<deal_t, uint64_t, &deal_t::by_ordersn> >,
+        indexed_by<"deadline"_n, const_mem_fun<deal_t, uint64_t, &deal_t::by_deadline> >,
+        indexed_by<"taker"_n,   const_mem_fun<deal_t, uint128_t, &deal_t::by_taker> >,
+        indexed_by<"arbiter"_n, const_mem_fun<deal_t, uint128_t, &deal_t::by_arbiter> >
     > idx_t;
 
-    EOSLIB_SERIALIZE(deal_t,    (id)(order_side)(order_id)(order_price)(deal_quantity)
-                                (order_maker)(merchant_name)
-                                (order_taker)(deal_fee)(fine_amount)(pay_type)
-                                (status)(arbit_status)(arbiter)
-                                (created_at)(closed_at)(updated_at)(order_sn)
-                                (merchant_accepted_at)(merchant_paid_at)
+    EOSLIB_SERIALIZE(deal_t,    (id)(order_id)(coin_symbol)(price)(quantity)(fee)
+                                (order_maker)(order_taker)(pay_type)(arbiter)(flags)(order_sn)
+                                (created_at)(updated_at)(accepted_after)(paid_after)
                                 (close_msg))
+
+private:
+    // 0 for unset time, time before created_at is taken as created_at
+    uint32_t _after(const time_point_sec& t) const {
+        if (t.utc_seconds == 0) return 0;
+        return t.utc_seconds > created_at.utc_seconds ? t.utc_seconds - created_at.utc_seconds + 1 : 1;
+    }
+    time_point_sec _time_after(const unsigned_int& after) const {
+        return after.value == 0 ? time_point_sec() : time_point_sec(created_at.utc_seconds + after.value - 1);
+    }
 };
 
 struct OTCBOOK_TBL blacklist_t {
@@ -388,9 +815,24 @@ struct OTCBOOK_TBL blacklist_t {
     uint64_t primary_key() const { return account.value; }
     uint64_t scope() const { return /*order_price.symbol.code().raw()*/ 0; }
 
-    typedef wasm::db::multi_index_ex <"blacklist"_n, blacklist_t> idx_t;
+    uint128_t by_expiry() const { return (uint128_t)expired_at.utc_seconds << 64 | account.value; }
+
+    typedef wasm::db::multi_index_ex <"blacklist"_n, blacklist_t,
+        indexed_by<"expiry"_n, const_mem_fun<blacklist_t, uint128_t, &blacklist_t::by_expiry> >
+    > idx_t;
 };
 
+/**
+ * blacklist before expiry index added, see otcbook::migrateblack
+ */
+struct OTCBOOK_TBL legacy_blacklist_t {
+    name account;
+    time_point_sec expired_at;
+
+    uint64_t primary_key() const { return account.value; }
+
+    typedef eosio::multi_index <"blacklist"_n, legacy_blacklist_t> idx_t;
+};
 
 struct OTCBOOK_TBL arbiter_t {
     name        account;               // account, PK
@@ -408,4 +850,23 @@ struct OTCBOOK_TBL arbiter_t {
     EOSLIB_SERIALIZE(arbiter_t,  (account)(email)(failed_case_num)(closed_case_num)(total_quant) )
 };
 
+/**
+ * open cases of arbiter, the arbiter with fewest open cases is the first of opencase index
+ */
+struct OTCBOOK_TBL arbiter_load_t {
+    name        account;               // account, PK
+    uint64_t    open_case_num = 0;
+
+    arbiter_load_t() {};
+    arbiter_load_t( const name& c ) : account( c ) {}
+
+    uint64_t primary_key() const { return account.value; }
+    uint128_t by_open_case() const { return (uint128_t)open_case_num << 64 | account.value; }
+
+    typedef eosio::multi_index <"arbitloads"_n, arbiter_load_t,
+        indexed_by<"opencase"_n, const_mem_fun<arbiter_load_t, uint128_t, &arbiter_load_t::by_open_case> >
+    > idx_t;
+    EOSLIB_SERIALIZE(arbiter_load_t,  (account)(open_case_num) )
+};
+
 } // AMA
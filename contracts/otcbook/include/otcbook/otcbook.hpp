@@ -44,27 +44,38 @@ if ( debug ) {                               \
    eosio::print( __VA_ARGS__ ); }}
 
 class [[eosio::contract("otcbook")]] otcbook: public eosio::contract {
-    using conf_t = otc::global_t;
-    using conf_table_t = otc::global_singleton;
+    using conf_t = otc::conf_digest_t;
+    using hot_conf_t = otc::fiat_conf_hot_t;
 
 private:
     dbc                 _dbc;
     global_singleton    _global;
     global_t            _gstate;
-    std::unique_ptr<conf_table_t> _conf_tbl_ptr;
-    std::unique_ptr<conf_t> _conf_ptr;
+    global2_singleton   _global2;
+    global2_t           _gstate2;
+    bool                _gstate2_changed = false;   // global2 is written back on exit only if changed
+    std::unique_ptr<conf_t> _conf_ptr;              // conf decoded once per action, see _conf()
+    std::unique_ptr<hot_conf_t> _hot_conf_ptr;      // hot conf decoded once per action, see _hot_conf()
+    std::map<name, merchant_t> _merchants;          // merchants changed in this action, written back once on exit
 
 public:
     using contract::contract;
     otcbook(eosio::name receiver, eosio::name code, datastream<const char*> ds):
         _dbc(_self), contract(receiver, code, ds),
-        _global(_self, _self.value)
+        _global(_self, _self.value),
+        _global2(_self, _self.value)
     {
         _gstate = _global.exists() ? _global.get() : global_t{};
+        _gstate2 = _global2.exists() ? _global2.get() : global2_t{};
     }
 
     ~otcbook() {
+        for (const auto& item : _merchants) {
+            _dbc.set( item.second, get_self() );
+        }
         _global.set( _gstate, get_self() ); 
+        if (_gstate2_changed)
+            _global2.set( _gstate2, get_self() );
     }
 
     /**
@@ -74,6 +85,101 @@ public:
      */
     ACTION setconf(const name &conf_contract, const name& token_split_contract, const uint64_t& token_split_plan_id );
     ACTION setadmin( const name& admin, const bool& to_add);
+
+    /**
+     * set retention of closed deals
+     * @param deal_retention_sec closed or cancelled deals older than it can be pruned, 0: never
+     * @note require admin auth
+     */
+    ACTION setretention( const name& sender, const uint32_t& deal_retention_sec );
+
+    /**
+     * set limits of merchant
+     * @param max_open_orders max open orders of a merchant, 0: no limit
+     * @note require admin auth
+     */
+    ACTION setlimits( const name& sender, const uint32_t& max_open_orders );
+
+    /**
+     * set threshold of accrued deal fees of a symbol to transfer them to token split contract
+     * @param threshold flush fees of its symbol once accrued reaches it, 0: no threshold
+     * @note require admin auth
+     */
+    ACTION setfeeflush( const name& sender, const asset& threshold );
+
+    /**
+     * set interval of transferring accrued deal fees to token split contract
+     * @param flush_interval_sec flush fees of any symbol on the first deal closed after it elapsed, 0: no interval
+     * @note require admin auth
+     */
+    ACTION setflushint( const name& sender, const uint32_t& flush_interval_sec );
+
+    /**
+     * transfer accrued deal fees of symbol to token split contract
+     * @note anyone can call
+     */
+    ACTION flushfee( const symbol& sym );
+
+    /**
+     * set settle mode of closed deals
+     * @param async if true, closed deals are queued and settled in bulk by settle::drain, otherwise settled inline
+     * @note require admin auth, ram of the queue is paid by this contract, drained rows are erased by purgesettle()
+     */
+    ACTION setsettle( const name& sender, const bool& async );
+
+    /**
+     * erase queued deals already drained by settle contract, earliest queued first, does nothing if none drained
+     * @param max_rows max count of rows to erase
+     * @note anyone can call
+     */
+    ACTION purgesettle( const uint32_t& max_rows );
+
+    /**
+     * erase closed or cancelled deals older than retention, oldest closed first
+     * @param market_id market of deals
+     * @param max_rows max deal rows to erase
+     * @note require admin auth
+     */
+    ACTION prunedeals( const name& sender, const uint64_t& market_id, const uint32_t& max_rows );
+
+    /**
+     * add a market of fiat and coin besides the default market of conf fiat_type
+     * @param fiat price symbol of orders
+     * @param coin va quantity symbol of orders, stake coin of it must be configured
+     * @param order_sides sides of orders allowed in the market, buy | sell
+     * @param pay_types pay types allowed in the market
+     * @note require admin auth
+     */
+    ACTION addmarket( const name& sender, const symbol& fiat, const symbol& coin,
+                      const set<name>& order_sides, const set<name>& pay_types );
+
+    /**
+     * enable or disable a market, orders and deals can not be opened in a disabled market
+     * @note require admin auth
+     */
+    ACTION setmarket( const name& sender, const uint64_t& market_id, const bool& enabled );
+
+    /**
+     * set order sides and pay types allowed in a market, open orders and deals are not affected
+     * @note require admin auth
+     */
+    ACTION setmktpolicy( const name& sender, const uint64_t& market_id, const set<name>& order_sides, const set<name>& pay_types );
+
+    /**
+     * receive the conf digest published by conf contract
+     * @param conf conf digest of this contract
+     * @param version conf version of the digest
+     * @note require conf contract auth
+     */
+    ACTION pubconf( const conf_digest_t& conf, const uint64_t& version );
+
+    /**
+     * receive the hot conf published by conf contract
+     * @param conf hot conf of this contract
+     * @param version hot conf version
+     * @note require conf contract auth
+     */
+    ACTION pubhotconf( const fiat_conf_hot_t& conf, const uint64_t& version );
     
     /**
      * set merchant
@@ -88,11 +194,16 @@ public:
     ACTION setarbiter( const uint64_t& deal_id, const name& arbiter ) {
         require_auth( _self );
 
-        auto deal = deal_t( deal_id );
-        check( _dbc.get( deal ), "deal not found" );
-        deal.arbiter = arbiter;
-
-        _dbc.set( deal );
+        deal_t::idx_t deals(_self, _scope_of(deal_id));
+        auto deal_itr = _find_deal(deals, deal_id);
+        check( deal_itr != deals.end(), "deal not found" );
+        if (deal_itr->arbit_status() == (uint8_t)arbit_status_t::ARBITING) {
+            _close_case( deal_itr->arbiter );
+            _open_case( arbiter );
+        }
+        deals.modify( deal_itr, same_payer, [&]( auto& row ) {
+            row.arbiter = arbiter;
+        });
 
     }
 
@@ -103,6 +214,7 @@ public:
 
     /**
      * open order by merchant
+     * the order is opened in the market of va_price symbol and va_quantity symbol
      * @param owner merchant account name
      * @param order_side order side, buy | sell
      * @param va_quantity  va quantity for buy|sell, (ex. "1.0000 CNYD")
@@ -146,12 +258,43 @@ public:
     [[eosio::action]]
     void closeorder(const name& owner, const name& order_side, const uint64_t& order_id);
 
+    /**
+     * migrate orders created before price index added, so that they can be found by price index and counted in depth
+     * migrated orders are skipped, so it is safe to run it again from any order id
+     * @param order_side order side, buy | sell
+     * @param start_id migrate orders from this order id
+     * @param max_rows max count of orders to migrate
+     * @note require contract auth
+     */
+    [[eosio::action]]
+    void migrateorder(const name& order_side, const uint64_t& start_id, const uint64_t& max_rows);
+
+    /**
+     * move deals of earlier versions to the compact deals table, deals are also moved on first access
+     * terminal deals out of retention are dropped instead of moved
+     * @param start_id migrate deals from this deal id
+     * @param max_rows max count of deals to migrate
+     * @note require contract auth
+     */
+    ACTION migratedeal(const uint64_t& start_id, const uint64_t& max_rows);
+
+    /**
+     * erase closed orders left by earlier versions, orders are reclaimed at close time now
+     * only migrated orders are found, run migrateorder() first
+     * @param sender admin account
+     * @param market_id market of orders
+     * @param order_side order side, buy | sell
+     * @param max_rows max count of untakeable orders to scan
+     * @note require admin auth
+     */
+    ACTION purgeorders(const name& sender, const uint64_t& market_id, const name& order_side, const uint32_t& max_rows);
+
     /**
      * open deal by user
      * @param taker user account name
-     * @param order_id order id, created in openorder()
+     * @param order_id order id, created in openorder(), the deal is opened in the market of it
      * @param deal_quantity deal quantity of va
-     * @param order_sn order_sn should be unique to locate current deal
+     * @param order_sn order_sn should be unique across markets to locate current deal
      * @param session_msg session msg(message)
      * @note require taker auth
      */
@@ -159,6 +302,22 @@ public:
     void opendeal(const name& taker, const name& order_side, const uint64_t& order_id,
         const asset& deal_quantity, const uint64_t& order_sn, const name& pay_type);
 
+    /**
+     * take the best orders of one side by user, open one deal for each taken order
+     * orders are taken in price-time order, at most max_take_best_orders orders are taken
+     * and at most max_take_best_scan orders are scanned, orders of other coins or not acceptable are skipped
+     * @param taker user account name
+     * @param order_side side of orders to take, buy | sell
+     * @param quantity total deal quantity of va, some of it may be left if orders insufficient
+     * @param limit_price worst acceptable price, max price for sell orders, min price for buy orders
+     * @param order_sn order_sn should be unique across markets, all deals opened by this call share it, find them by ordersn index
+     * @param pay_type pay type, only orders accepting it are taken
+     * @note require taker auth
+     */
+    [[eosio::action]]
+    void takebest(const name& taker, const name& order_side, const asset& quantity,
+        const asset& limit_price, const uint64_t& order_sn, const name& pay_type);
+
     /**
      * close deal
      * merchat/user can close deal when status in [CREATED | MAKER_RECV_AND_SENT]
@@ -166,6 +325,7 @@ public:
      * @param account account name
      * @param account_type account type, admin(1) | merchant(2) | user(3)
      * @param deal_id deal_id, created by opendeal()
+     * @param close_msg only the first max_close_msg_size bytes are kept in the deal
      * @note require account auth
      */
     [[eosio::action]]
@@ -294,17 +454,46 @@ public:
     [[eosio::action]]
     void setblacklist(const name& from, const name& account, uint64_t duration_second);
 
+    /**
+     * erase expired blacklist, earliest expired first, does nothing if none expired
+     * @param max_rows max count of rows to erase
+     * @note anyone can call
+     */
+    [[eosio::action]]
+    void purgeblack(const uint32_t& max_rows);
+
+    /**
+     * migrate blacklist created before expiry index added, the row is paid by contract after migrated
+     * migrated rows are skipped, so it is safe to run it again from any account
+     * @param start_account migrate blacklist from this account
+     * @param max_rows max count of rows to migrate
+     * @note require contract auth
+     */
+    [[eosio::action]]
+    void migrateblack(const name& start_account, const uint32_t& max_rows);
+
     [[eosio::action]]
     void addarbiter(const name& sender, const name& account, const string& email);
 
     [[eosio::action]]
     void delarbiter(const name& sender, const name& account);
 
+    /**
+     * correct arbiter count of global, the count is informational, arbiters are picked by open cases
+     * @note require contract auth
+     */
     [[eosio::action]]
     void setarbitcnt ( const uint64_t count);
 
-    // [[eosio::action]]
-    // void timeoutdeal();
+    /**
+     * cancel deals not accepted or not paid in accepted_timeout of conf, earliest first, does nothing if none expired
+     * deals of missing or closed orders are skipped, they can be cancelled by admin with canceldeal()
+     * @param market_id market of deals
+     * @param max_rows max count of expired deals to scan, skipped ones included
+     * @note anyone can call
+     */
+    [[eosio::action]]
+    void timeoutdeal(const uint64_t& market_id, const uint32_t& max_rows);
 
     [[eosio::action]]
     void stakechanged(const name& account, const asset &quantity, const string& memo);
@@ -315,9 +504,22 @@ public:
     [[eosio::action]]
     void rejectmerch(const name& account, const string& reject_reason, const time_point_sec& curr_ts);
 
+    [[eosio::action]]
+    void dealevent(const name& account, const deal_event_t& event);
+
+    /**
+     * set notifications to receive
+     * @param account account to be notified
+     * @param flags bits of notify_flag_t, deal info(1) | deal event(2) | stake changed(4)
+     * @note require account auth
+     */
+    [[eosio::action]]
+    void setnotify(const name& account, const uint8_t& flags);
+
     using stakechanged_action = eosio::action_wrapper<"stakechanged"_n, &otcbook::stakechanged>;
     using dealnotify_action = eosio::action_wrapper<"dealnotifyv2"_n, &otcbook::dealnotifyv2>;
     using reject_merchant_action = eosio::action_wrapper<"rejectmerch"_n, &otcbook::rejectmerch>;
+    using deal_event_action = eosio::action_wrapper<"dealevent"_n, &otcbook::dealevent>;
 
 private:
     void _deposit(name from, name to, asset quantity, string memo);
@@ -332,9 +534,22 @@ private:
 
     asset _calc_deal_amount(const asset &quantity);
 
-    const fiat_conf_t& _conf(bool refresh = false);
+    const conf_digest_t& _conf(bool refresh = false);
+    const fiat_conf_hot_t& _hot_conf(bool refresh = false);
 
     void _set_blacklist(const name& account, uint64_t duration_second, const name& payer);
+    uint32_t _purge_blacklist(blacklist_t::idx_t& blacklist_tbl, const uint32_t& max_rows);
+
+    bool _get_merchant(merchant_t& merchant);
+    void _set_merchant(const merchant_t& merchant);
+
+    void _accrue_fee(const asset& fee);
+    void _flush_fee(fee_ledger_t& ledger);
+    void _queue_settle(const name& settle_contract, const deal_t& deal, const asset& quantity, const asset& fee);
+    uint32_t _purge_settle_queue(const name& settle_contract, const uint32_t& max_rows);
+
+    void _notify_deal(const name& account, const uint8_t& action_type, const deal_change_info& deal);
+    void _notify_stake(const name& account, const asset& quantity, const string& memo);
 
     void _add_balance(merchant_t& merchant, const asset& quantity, const string & memo);
     void _sub_balance(merchant_t& merchant, const asset& quantity, const string & memo);
@@ -356,16 +571,61 @@ private:
 
     void _transfer_usdt(name to, asset quantity, uint64_t deal_id);
 
-    void _rand_arbiter( const uint64_t deal_id, name& arbiter );
+    name _pick_arbiter();
+    void _open_case( const name& arbiter );
+    void _close_case( const name& arbiter );
 
     void _check_split_plan( const name& token_split_contract, const uint64_t& token_split_plan_id, const name& scope );
 
     void _opendeal( const name& taker, const name& order_side, const uint64_t& order_id,
                         const asset& deal_quantity, const uint64_t& order_sn, const name& pay_type);
+
+    template<typename table_t>
+    asset _take_best( const uint64_t& market_id, const name& taker, const name& order_side, const asset& quantity,
+                        const asset& limit_price, const uint64_t& order_sn, const name& pay_type);
+
+    void _check_blacklist( const name& taker );
+    void _check_order_sn( const uint64_t& order_sn );
+
+    uint64_t _create_deal( const uint64_t& market_id, const order_t& order, const name& order_side, const name& taker,
+                        const asset& deal_quantity, const uint64_t& order_sn, const name& pay_type);
     
     void _update_arbiter_info( const name& account, const asset& quant, const bool& closed);
 
     void _require_admin(const name& account);
+
+    template<typename legacy_table_t, typename table_t>
+    void _migrate_orders(const name& order_side, uint128_t (order_t::*price_key)() const, const uint64_t& start_id, const uint64_t& max_rows);
+
+    template<typename table_t>
+    void _purge_orders(const uint64_t& market_id, const uint32_t& max_rows);
+
+    template<typename Lambda>
+    void _modify_order(order_wrapper_t& order_wrapper, Lambda&& updater);
+    void _erase_order(order_wrapper_t& order_wrapper);
+    void _update_depth(const uint64_t& market_id, const name& order_side, const asset& price, const asset& before, const asset& after);
+    void _update_book_top(depth_t::idx_t& depth, const name& order_side);
+    void _update_merchant_stats(const name& owner, const int32_t& open_orders, const int32_t& running_deals,
+                                const asset& frozen, const asset& fulfilled);
+    void _count_legacy_deal(const deal_t& deal);
+
+    void _cancel_deal(deal_t::idx_t& deals, deal_t::idx_t::const_iterator deal_itr, const bool& pause_order);
+    void _cancel_deal(deal_t::idx_t& deals, deal_t::idx_t::const_iterator deal_itr, order_wrapper_t& order_wrapper, const bool& pause_order);
+
+    deal_t::idx_t::const_iterator _find_deal(deal_t::idx_t& deals, const uint64_t& deal_id);
+
+    uint64_t _route_market(const symbol& fiat, const symbol& coin);
+    void _check_market(const uint64_t& market_id);
+    void _check_market_policy(const uint64_t& market_id, const name& order_side, const symbol& coin, const set<name>& pay_types);
+    void _set_market_policy(market_t& market, const set<name>& order_sides, const set<name>& pay_types);
+    uint64_t _next_order_id(const uint64_t& market_id, const name& order_side);
+    uint64_t _next_deal_id(const uint64_t& market_id);
+
+    // scope of orders and deals of market, the default market keeps contract scope
+    uint64_t _market_scope(const uint64_t& market_id) const {
+        return market_id == default_market_id ? get_self().value : market_id;
+    }
+    uint64_t _scope_of(const uint64_t& order_or_deal_id) const { return _market_scope(market_of(order_or_deal_id)); }
     
 };
 
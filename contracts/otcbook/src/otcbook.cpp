@@ -17,6 +17,10 @@ static constexpr eosio::name active_permission{"active"_n};
     {	metabalance::otcbook::dealnotify_action act{ _self, { {_self, active_permission} } };\
 			act.send( account, info , action_type, deal );}
 
+#define DEAL_EVENT(account, event) \
+    {	metabalance::otcbook::deal_event_action act{ _self, { {_self, active_permission} } };\
+			act.send( account, event );}
+
 #define REJECT_MERCHANT(account, reject_reason, curr) \
     {	metabalance::otcbook::reject_merchant_action act{ _self, { {_self, active_permission} } };\
 			act.send( account, reject_reason , curr );}
@@ -43,23 +47,23 @@ inline int64_t get_precision(const asset &a) {
 
 asset otcbook::_calc_order_stakes(const asset &quantity) {
     // calc order quantity value by price
-    auto stake_symbol = _conf().coin_as_stake.at(quantity.symbol);
+    auto stake_symbol = _hot_conf().stake_coin(quantity.symbol);
     auto value = multiply_decimal64( quantity.amount, get_precision(stake_symbol), get_precision(quantity) );
     int64_t amount = divide_decimal64(value, order_stake_pct, percent_boost);
     return asset(amount, stake_symbol);
 }
 
 asset otcbook::_calc_deal_amount(const asset &quantity) {
-    auto stake_symbol = _conf().coin_as_stake.at(quantity.symbol);
+    auto stake_symbol = _hot_conf().stake_coin(quantity.symbol);
     auto value = multiply_decimal64( quantity.amount, get_precision(stake_symbol), get_precision(quantity) );
     return asset(value, stake_symbol);
 }
 
 asset otcbook::_calc_deal_fee(const asset &quantity) {
     // calc order quantity value by price
-    auto stake_symbol = _conf().coin_as_stake.at(quantity.symbol);
+    auto stake_symbol = _hot_conf().stake_coin(quantity.symbol);
     auto value = multiply_decimal64( quantity.amount, get_precision(stake_symbol), get_precision(quantity) );
-    const auto & fee_pct = _conf().fee_pct;
+    const auto & fee_pct = _hot_conf().fee_pct;
     if (fee_pct  == 0) {
         return asset(0, stake_symbol);
     }
@@ -76,6 +80,7 @@ void otcbook::setconf(const name &conf_contract, const name& token_split_contrac
     _gstate.token_split_plan_id = token_split_plan_id;
     _check_split_plan( token_split_contract, token_split_plan_id, _self );
     _conf(true);
+    _hot_conf(true);
 }
 
 void otcbook::setadmin( const name& account, const bool& to_add) {
@@ -91,6 +96,160 @@ void otcbook::setadmin( const name& account, const bool& to_add) {
         _dbc.set( admin, _self );
 }
 
+void otcbook::setretention( const name& sender, const uint32_t& deal_retention_sec ) {
+    _require_admin( sender );
+
+    _gstate2.deal_retention_sec = deal_retention_sec;
+    _gstate2_changed = true;
+}
+
+void otcbook::setlimits( const name& sender, const uint32_t& max_open_orders ) {
+    _require_admin( sender );
+
+    _gstate2.max_open_orders = max_open_orders;
+    _gstate2_changed = true;
+}
+
+void otcbook::setfeeflush( const name& sender, const asset& threshold ) {
+    _require_admin( sender );
+    CHECKC( threshold.is_valid() && threshold.amount >= 0, err::INVALID_QUANTITY, "invalid threshold" );
+
+    auto ledger = fee_ledger_t(threshold.symbol);
+    _dbc.get( ledger );
+    ledger.threshold = threshold;
+    _dbc.set( ledger, get_self() );
+}
+
+void otcbook::setflushint( const name& sender, const uint32_t& flush_interval_sec ) {
+    _require_admin( sender );
+
+    _gstate2.fee_flush_interval_sec = flush_interval_sec;
+    _gstate2_changed = true;
+}
+
+void otcbook::setsettle( const name& sender, const bool& async ) {
+    _require_admin( sender );
+
+    _gstate2.settle_async = async;
+    _gstate2_changed = true;
+}
+
+void otcbook::flushfee( const symbol& sym ) {
+    auto ledger = fee_ledger_t(sym);
+    CHECKC( _dbc.get( ledger ), err::RECORD_NOT_FOUND, "fee ledger not found: " + sym.code().to_string() );
+    CHECKC( ledger.accrued.amount > 0, err::NOT_POSITIVE, "no fee accrued" );
+
+    _flush_fee( ledger );
+    _dbc.set( ledger, get_self() );
+}
+
+void otcbook::_accrue_fee(const asset& fee) {
+    auto ledger = fee_ledger_t(fee.symbol);
+    if ( !_dbc.get( ledger ) )
+        ledger.flushed_at = current_time_point();
+    ledger.accrued += fee;
+
+    auto interval = _gstate2.fee_flush_interval_sec;
+    if ( (ledger.threshold.amount > 0 && ledger.accrued >= ledger.threshold) ||
+         (interval > 0 && ledger.flushed_at + interval <= current_time_point()) )
+        _flush_fee( ledger );
+
+    _dbc.set( ledger, get_self() );
+}
+
+void otcbook::_flush_fee(fee_ledger_t& ledger) {
+    TRANSFER( MBANK, _gstate.token_split_contract, ledger.accrued, std::string("plan:") + to_string( _gstate.token_split_plan_id) + ":" + to_string(ledger.accrued.amount) )
+    ledger.accrued.amount   = 0;
+    ledger.flushed_at       = current_time_point();
+}
+
+void otcbook::prunedeals( const name& sender, const uint64_t& market_id, const uint32_t& max_rows ) {
+    _require_admin( sender );
+    CHECKC( max_rows > 0, err::NOT_POSITIVE, "max_rows must be positive" )
+    CHECKC( _gstate2.deal_retention_sec > 0, err::PARAM_ERROR, "deal retention not set" )
+
+    auto now = current_time_point().sec_since_epoch();
+    CHECKC( now > _gstate2.deal_retention_sec, err::PARAM_ERROR, "deal retention too large" )
+    uint64_t expired_at = now - _gstate2.deal_retention_sec;
+
+    // only terminal deals are keyed by time in closedat, open deals sort to the end and are never scanned
+    deal_t::idx_t deals(_self, _market_scope(market_id));
+    auto close_idx = deals.get_index<"closedat"_n>();
+    auto itr = close_idx.begin();
+    for (uint32_t count = 0; count < max_rows && itr != close_idx.end() && itr->by_close_time() < expired_at; count++) {
+        itr = close_idx.erase(itr);
+    }
+}
+
+void otcbook::addmarket( const name& sender, const symbol& fiat, const symbol& coin,
+                         const set<name>& order_sides, const set<name>& pay_types ) {
+    _require_admin( sender );
+    CHECKC( fiat.is_valid() && coin.is_valid(), err::PARAM_ERROR, "invalid symbol" )
+    const auto& conf = _conf();
+    CHECKC( fiat != conf.fiat_type, err::PRICE_SYMBOL_NOT_ALLOW, "fiat of default market: " + fiat.code().to_string() )
+    CHECKC( _hot_conf().has_stake_coin(coin), err::QUANTITY_SYMBOL_NOT_ALLOW, "coin hasn't config stake asset: " + coin.code().to_string() )
+
+    auto& markets = _dbc.get_tbl<market_t>(_self.value);
+    auto symbols_idx = markets.get_index<"symbols"_n>();
+    auto itr = symbols_idx.find( market_t::make_key(fiat, coin) );
+    CHECKC( itr == symbols_idx.end() || itr->fiat != fiat || itr->coin != coin, err::RECORD_EXISTING,
+        "market existed: " + to_string(itr->id) )
+
+    auto market = market_t( std::max<uint64_t>(1, markets.available_primary_key()) );
+    CHECKC( market.id <= max_market_id, err::PARAM_ERROR, "markets exceed limit: " + to_string(max_market_id) )
+    market.fiat = fiat;
+    market.coin = coin;
+    _set_market_policy( market, order_sides, pay_types );
+    _dbc.set( market, get_self() );
+}
+
+void otcbook::setmarket( const name& sender, const uint64_t& market_id, const bool& enabled ) {
+    _require_admin( sender );
+
+    auto market = market_t(market_id);
+    CHECKC( _dbc.get( market ), err::RECORD_NOT_FOUND, "market not found: " + to_string(market_id) )
+    market.enabled = enabled;
+    _dbc.set( market );
+}
+
+void otcbook::setmktpolicy( const name& sender, const uint64_t& market_id, const set<name>& order_sides, const set<name>& pay_types ) {
+    _require_admin( sender );
+
+    auto market = market_t(market_id);
+    CHECKC( _dbc.get( market ), err::RECORD_NOT_FOUND, "market not found: " + to_string(market_id) )
+    _set_market_policy( market, order_sides, pay_types );
+    _dbc.set( market );
+}
+
+void otcbook::_set_market_policy( market_t& market, const set<name>& order_sides, const set<name>& pay_types ) {
+    CHECKC( !order_sides.empty(), err::PARAM_ERROR, "order sides empty" )
+    for (const auto& side : order_sides) {
+        CHECKC( ORDER_SIDES.count(side) != 0, err::INVALID_ORDER_SIZE, "Invalid order side: " + side.to_string() )
+    }
+    CHECKC( !pay_types.empty(), err::PARAM_ERROR, "pay types empty" )
+
+    market.order_sides  = flat::set<name>(order_sides.begin(), order_sides.end());
+    market.pay_types    = flat::set<name>(pay_types.begin(), pay_types.end());
+}
+
+void otcbook::pubconf( const conf_digest_t& conf, const uint64_t& version ) {
+    require_auth( _gstate.conf_contract );
+    CHECKC( conf.contract_name == get_self(), err::PARAM_ERROR, "conf of other contract: " + conf.contract_name.to_string() );
+
+    conf_digest_singleton conf_digest_tbl(_self, _self.value);
+    conf_digest_tbl.set( conf_digest_tbl_t( conf, version ), get_self() );
+    _conf_ptr.reset();
+}
+
+void otcbook::pubhotconf( const fiat_conf_hot_t& conf, const uint64_t& version ) {
+    require_auth( _gstate.conf_contract );
+    CHECKC( conf.contract_name == get_self(), err::PARAM_ERROR, "conf of other contract: " + conf.contract_name.to_string() );
+
+    conf_hot_singleton conf_hot_tbl(_self, _self.value);
+    conf_hot_tbl.set( conf_hot_tbl_t( conf, version ), get_self() );
+    _hot_conf_ptr.reset();
+}
+
 void otcbook::setmerchant( const name& sender, const merchant_info& mi ) {
     // CHECKC( has_auth(_conf().managers.at(otc::manager_type::admin)), err::NO_AUTH, "neither admin nor merchant" )
     _require_admin( sender );
@@ -103,7 +262,7 @@ void otcbook::setmerchant( const name& sender, const merchant_info& mi ) {
     CHECKC(mi.reject_reason.size() < 255,err::REJECT_REASON_TOO_LARGE, "reject reason size too large: " + to_string(mi.memo.size()) );
 
     auto merchant = merchant_t(mi.account);
-    auto found = _dbc.get(merchant);
+    auto found = _get_merchant(merchant);
     CHECKC( found, err::ACCOUNT_NOT_FOUND, "merchant not existing: " + mi.account.to_string() )
     
     merchant.status = mi.status;
@@ -117,7 +276,7 @@ void otcbook::setmerchant( const name& sender, const merchant_info& mi ) {
         REJECT_MERCHANT(merchant.owner, mi.reject_reason, time_point_sec(current_time_point()) );
     }
 
-    _dbc.set( merchant, get_self() );
+    _set_merchant(merchant);
 }
 
 
@@ -131,7 +290,7 @@ void otcbook::remerchant( const merchant_info& mi) {
     // CHECKC(mi.reject_reason.size() < 255,err::REJECT_REASON_TOO_LARGE, "reject reason size too large: " + to_string(mi.memo.size()) );
 
     auto merchant = merchant_t(mi.account);
-    auto found = _dbc.get(merchant);
+    auto found = _get_merchant(merchant);
     CHECKC( found, err::ACCOUNT_NOT_FOUND, "merchant not found: " + mi.account.to_string() )
     CHECKC( merchant.status == (uint8_t)merchant_status_t::REJECT &&  mi.status == (uint8_t)merchant_status_t::REGISTERED, err::NO_AUTH, "merchant status is not reject.")
     merchant.status = (uint8_t)merchant_status_t::REGISTERED;
@@ -140,15 +299,16 @@ void otcbook::remerchant( const merchant_info& mi) {
     if ( mi.merchant_detail.length() > 0 ) merchant.merchant_detail    = mi.merchant_detail;
     if ( mi.email.length() > 0 )           merchant.email              = mi.email;
     if ( mi.memo.length() > 0 )            merchant.memo               = mi.memo;
-    _dbc.set( merchant, get_self() );
+    _set_merchant(merchant);
 }
 
 void otcbook::delmerchant( const name& sender, const name& merchant_acct ) {
     _require_admin( sender );
 
     auto merchant = merchant_t( merchant_acct );
-    CHECKC( _dbc.get(merchant), err::RECORD_NOT_FOUND, "merchant not found: " + merchant_acct.to_string() )
+    CHECKC( _get_merchant(merchant), err::RECORD_NOT_FOUND, "merchant not found: " + merchant_acct.to_string() )
 
+    _merchants.erase( merchant.owner );
     _dbc.del( merchant );
 
 }
@@ -159,23 +319,14 @@ void otcbook::delmerchant( const name& sender, const name& merchant_acct ) {
 void otcbook::openorder(const name& owner, const name& order_side, const set<name> &pay_methods, const asset& va_quantity, const asset& va_price,
     const asset& va_min_take_quantity,  const asset& va_max_take_quantity, const string &memo
 ){
-    CHECKC(_conf().status == conf_status::RUNNING,err::UNINITIALIZED, "service is in maintenance");
+    CHECKC(_hot_conf().status == conf_status::RUNNING,err::UNINITIALIZED, "service is in maintenance");
     require_auth( owner );
     CHECKC( ORDER_SIDES.count(order_side) != 0,err::INVALID_ORDER_SIZE, "Invalid order side" );
     CHECKC( va_quantity.is_valid(),err::INVALID_QUANTITY, "Invalid quantity");
     CHECKC( va_price.is_valid(),err::INVALID_PRICE, "Invalid va_price");
-    const auto& conf = _conf();
-    CHECKC( va_price.symbol == conf.fiat_type,err::PAY_TYPE_NOT_ALLOW, "va price symbol not allow");
-    CHECKC( conf.coin_as_stake.count(va_quantity.symbol),err::QUANTITY_SYMBOL_NOT_ALLOW, "va quantity symbol hasn't config stake asset");
-    if (order_side == BUY_SIDE) {
-        CHECKC( conf.buy_coins_conf.count(va_quantity.symbol) != 0,err::QUANTITY_SYMBOL_NOT_ALLOW, "va quantity symbol not allowed for buying" );
-    } else {
-        CHECKC( conf.sell_coins_conf.count(va_quantity.symbol) != 0,err::QUANTITY_SYMBOL_NOT_ALLOW, "va quantity symbol not allowed for selling" );
-    }
-
-    for (auto& method : pay_methods) {
-        CHECKC( conf.pay_type.count(method) != 0,err::PAY_TYPE_NOT_ALLOW, "pay method illegal: " + method.to_string() );
-    }
+    auto market_id = _route_market(va_price.symbol, va_quantity.symbol);
+    CHECKC( _hot_conf().has_stake_coin(va_quantity.symbol),err::QUANTITY_SYMBOL_NOT_ALLOW, "va quantity symbol hasn't config stake asset");
+    _check_market_policy(market_id, order_side, va_quantity.symbol, pay_methods);
 
     CHECKC( va_quantity.amount > 0,err::QUANTITY_NOT_POSITIVE, "quantity must be positive");
     // TODO: min order quantity
@@ -189,10 +340,17 @@ void otcbook::openorder(const name& owner, const name& order_side, const set<nam
         "invalid va_max_take_quantity amount" );
 
     merchant_t merchant(owner);
-    CHECKC( _dbc.get(merchant),err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
+    CHECKC( _get_merchant(merchant),err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
     CHECKC((merchant_status_t)merchant.status >= merchant_status_t::BASIC,err::ACCOUNT_STATE_MISMATCH,
         "merchant not enabled");
 
+    if (_gstate2.max_open_orders > 0) {
+        auto stats = merchant_stats_t(owner);
+        _dbc.get(stats);
+        CHECKC( stats.open_order_count < _gstate2.max_open_orders, err::OPEN_ORDERS_EXCEEDED,
+            "open orders exceed limit: " + to_string(_gstate2.max_open_orders) );
+    }
+
     auto stake_frozen = _calc_order_stakes(va_quantity); // TODO: process 70% used-rate of stake
     _frozen(merchant, stake_frozen);
 
@@ -223,38 +381,202 @@ void otcbook::openorder(const name& owner, const name& order_side, const set<nam
     order.updated_at                = time_point_sec(current_time_point());
 
 
+    order.id = _next_order_id(market_id, order_side);
     if (order_side == BUY_SIDE) {
-        buy_order_table_t orders(_self, _self.value);
-        _gstate.buy_order_id++;
-        order.id = _gstate.buy_order_id;
+        buy_order_table_t orders(_self, _market_scope(market_id));
         orders.emplace( _self, [&]( auto& row ) {
             row = order;
         });
     } else {
-        sell_order_table_t orders(_self, _self.value);
-        _gstate.sell_order_id++;
-        order.id = _gstate.sell_order_id;
+        sell_order_table_t orders(_self, _market_scope(market_id));
         orders.emplace( _self, [&]( auto& row ) {
             row = order;
         });
     }
+    _update_depth(market_id, order_side, order.va_price, asset(0, va_quantity.symbol), order.takeable_quantity());
+    _update_merchant_stats(owner, 1, 0, asset(), asset());
+}
+
+template<typename Lambda>
+void otcbook::_modify_order(order_wrapper_t& order_wrapper, Lambda&& updater) {
+    const auto& order = order_wrapper.get_order();
+    auto before = order.takeable_quantity();
+    order_wrapper.modify(_self, std::forward<Lambda>(updater));
+    _update_depth(market_of(order.id), order_wrapper.side(), order.va_price, before, order.takeable_quantity());
+}
+
+void otcbook::_erase_order(order_wrapper_t& order_wrapper) {
+    const auto& order = order_wrapper.get_order();
+    _update_depth(market_of(order.id), order_wrapper.side(), order.va_price, order.takeable_quantity(), asset(0, order.va_quantity.symbol));
+    _update_merchant_stats(order.owner, -1, 0, asset(), asset());
+    order_wrapper.erase();
+}
+
+uint64_t otcbook::_route_market(const symbol& fiat, const symbol& coin) {
+    if (fiat == _conf().fiat_type) return default_market_id;
+
+    auto symbols_idx = _dbc.get_tbl<market_t>(_self.value).get_index<"symbols"_n>();
+    auto itr = symbols_idx.find( market_t::make_key(fiat, coin) );
+    CHECKC( itr != symbols_idx.end() && itr->fiat == fiat && itr->coin == coin, err::PRICE_SYMBOL_NOT_ALLOW,
+        "market not found: " + fiat.code().to_string() + "/" + coin.code().to_string() )
+    CHECKC( itr->enabled, err::PRICE_SYMBOL_NOT_ALLOW, "market disabled: " + to_string(itr->id) )
+    return itr->id;
+}
+
+/**
+ * coins and pay types of the default market follow conf, other markets have their own policy
+ */
+void otcbook::_check_market_policy(const uint64_t& market_id, const name& order_side, const symbol& coin, const set<name>& pay_types) {
+    if (market_id == default_market_id) {
+        const auto& conf = _conf();
+        if (order_side == BUY_SIDE) {
+            CHECKC( conf.can_buy(coin),err::QUANTITY_SYMBOL_NOT_ALLOW, "va quantity symbol not allowed for buying" );
+        } else {
+            CHECKC( conf.can_sell(coin),err::QUANTITY_SYMBOL_NOT_ALLOW, "va quantity symbol not allowed for selling" );
+        }
+        for (auto& method : pay_types) {
+            CHECKC( conf.has_pay_type(method),err::PAY_TYPE_NOT_ALLOW, "pay method illegal: " + method.to_string() );
+        }
+        return;
+    }
+
+    auto market = market_t(market_id);
+    CHECKC( _dbc.get( market ), err::RECORD_NOT_FOUND, "market not found: " + to_string(market_id) )
+    CHECKC( market.order_sides.count(order_side) != 0, err::QUANTITY_SYMBOL_NOT_ALLOW,
+        "order side not allowed in market " + to_string(market_id) + ": " + order_side.to_string() );
+    for (auto& method : pay_types) {
+        CHECKC( market.pay_types.count(method) != 0, err::PAY_TYPE_NOT_ALLOW,
+            "pay method not allowed in market " + to_string(market_id) + ": " + method.to_string() );
+    }
+}
+
+void otcbook::_check_market(const uint64_t& market_id) {
+    if (market_id == default_market_id) return;
+
+    auto market = market_t(market_id);
+    CHECKC( _dbc.get( market ), err::RECORD_NOT_FOUND, "market not found: " + to_string(market_id) )
+    CHECKC( market.enabled, err::PRICE_SYMBOL_NOT_ALLOW, "market disabled: " + to_string(market_id) )
+}
+
+uint64_t otcbook::_next_order_id(const uint64_t& market_id, const name& order_side) {
+    if (market_id == default_market_id)
+        return order_side == BUY_SIDE ? ++_gstate.buy_order_id : ++_gstate.sell_order_id;
+
+    auto market = market_t(market_id);
+    CHECKC( _dbc.get( market ), err::RECORD_NOT_FOUND, "market not found: " + to_string(market_id) )
+    auto& serial = order_side == BUY_SIDE ? market.buy_order_id : market.sell_order_id;
+    CHECKC( serial < max_market_serial, err::SYSTEM_ERROR, "order id overflow of market: " + to_string(market_id) )
+    serial++;
+    _dbc.set( market );
+    return market_id << market_id_shift | serial;
+}
+
+uint64_t otcbook::_next_deal_id(const uint64_t& market_id) {
+    if (market_id == default_market_id)
+        return ++_gstate.deal_id;
+
+    auto market = market_t(market_id);
+    CHECKC( _dbc.get( market ), err::RECORD_NOT_FOUND, "market not found: " + to_string(market_id) )
+    CHECKC( market.deal_id < max_market_serial, err::SYSTEM_ERROR, "deal id overflow of market: " + to_string(market_id) )
+    market.deal_id++;
+    _dbc.set( market );
+    return market_id << market_id_shift | market.deal_id;
+}
+
+void otcbook::_update_depth(const uint64_t& market_id, const name& order_side, const asset& price, const asset& before, const asset& after) {
+    if (before == after) return;
+
+    depth_t::idx_t depth(_self, depth_t::make_scope(market_id, after.symbol));
+    auto key = depth_t::make_key(order_side, price);
+    int64_t count_delta = (after.amount > 0 ? 1 : 0) - (before.amount > 0 ? 1 : 0);
+    auto itr = depth.find(key);
+    if (itr == depth.end()) {
+        if (after < before) return;     // order not counted yet, see migrateorder()
+        depth.emplace( _self, [&]( auto& row ) {
+            row.key         = key;
+            row.side        = order_side;
+            row.price       = price;
+            row.quantity    = after - before;
+            row.order_count = count_delta;
+        });
+    } else if (itr->order_count + count_delta == 0) {
+        depth.erase(itr);
+    } else {
+        depth.modify( itr, same_payer, [&]( auto& row ) {
+            row.quantity    += after - before;
+            row.order_count += count_delta;
+        });
+    }
+    _update_book_top(depth, order_side);
+}
+
+void otcbook::_update_book_top(depth_t::idx_t& depth, const name& order_side) {
+    auto best = depth.end();
+    if (order_side == SELL_SIDE) {
+        auto itr = depth.begin();
+        if (itr != depth.end() && itr->side == SELL_SIDE) best = itr;
+    } else {
+        auto itr = depth.end();
+        if (itr != depth.begin() && (--itr)->side == BUY_SIDE) best = itr;
+    }
+
+    book_top_t::idx_t tops(_self, depth.get_scope());
+    auto top_itr = tops.find(order_side.value);
+    if (best == depth.end()) {
+        if (top_itr != tops.end()) tops.erase(top_itr);
+        return;
+    }
+
+    auto set_top = [&]( auto& row ) {
+        row.side        = order_side;
+        row.price       = best->price;
+        row.quantity    = best->quantity;
+        row.order_count = best->order_count;
+    };
+    if (top_itr == tops.end()) {
+        tops.emplace( _self, set_top );
+    } else if (top_itr->price != best->price || top_itr->quantity != best->quantity || top_itr->order_count != best->order_count) {
+        tops.modify( top_itr, same_payer, set_top );
+    }
+}
+
+void otcbook::_update_merchant_stats(const name& owner, const int32_t& open_orders, const int32_t& running_deals,
+                                     const asset& frozen, const asset& fulfilled) {
+    auto stats = merchant_stats_t(owner);
+    _dbc.get(stats);
+
+    // counts of orders and deals created before stats added are not known, so never below zero
+    stats.open_order_count      = std::max<int64_t>(0, (int64_t)stats.open_order_count + open_orders);
+    stats.running_deal_count    = std::max<int64_t>(0, (int64_t)stats.running_deal_count + running_deals);
+    if (frozen.amount != 0 || fulfilled.amount != 0) {
+        auto& stat = stats.assets[frozen.symbol];
+        stat.frozen     = std::max<int64_t>(0, stat.frozen + frozen.amount);
+        stat.fulfilled  += fulfilled.amount;
+    }
+    _dbc.set(stats, get_self());
+}
+
+void otcbook::_count_legacy_deal(const deal_t& deal) {
+    auto status = (deal_status_t)deal.status();
+    if (status == deal_status_t::CLOSED)
+        _update_merchant_stats(deal.order_maker, 0, 0, asset(0, deal.coin_symbol), deal.deal_quantity());
+    else if (status != deal_status_t::CANCELLED)
+        _update_merchant_stats(deal.order_maker, 0, 1, deal.deal_quantity(), asset(0, deal.coin_symbol));
 }
 
 void otcbook::pauseorder(const name& owner, const name& order_side, const uint64_t& order_id) {
     require_auth( owner );
 
     merchant_t merchant(owner);
-    CHECKC( _dbc.get(merchant),err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
+    CHECKC( _get_merchant(merchant),err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
     CHECKC( ORDER_SIDES.count(order_side) != 0,err::INVALID_ORDER_SIZE, "Invalid order side" );
 
-    auto order_wrapper_ptr = (order_side == BUY_SIDE) ?
-        buy_order_wrapper_t::get_from_db(_self, _self.value, order_id)
-        : sell_order_wrapper_t::get_from_db(_self, _self.value, order_id);
-    CHECKC( order_wrapper_ptr != nullptr,err::ORDER_NOT_FOUND, "order not found");
-    const auto &order = order_wrapper_ptr->get_order();
+    order_wrapper_t order_wrapper(order_side, _self, _scope_of(order_id), order_id);
+    CHECKC( order_wrapper.exists(),err::ORDER_NOT_FOUND, "order not found");
+    const auto &order = order_wrapper.get_order();
     CHECKC( owner == order.owner,err::NO_AUTH, "have no access to close others' order");
     CHECKC( (order_status_t)order.status == order_status_t::RUNNING,err::ORDER_STATE_NOT_RUNNING, "order not running" );
-    order_wrapper_ptr->modify(_self, [&]( auto& row ) {
+    _modify_order(order_wrapper, [&]( auto& row ) {
         row.status = (uint8_t)order_status_t::PAUSED;
         row.updated_at = time_point_sec(current_time_point());
     });
@@ -264,17 +586,15 @@ void otcbook::resumeorder(const name& owner, const name& order_side, const uint6
     require_auth( owner );
 
     merchant_t merchant(owner);
-    CHECKC( _dbc.get(merchant), err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
+    CHECKC( _get_merchant(merchant), err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
     CHECKC( ORDER_SIDES.count(order_side) != 0, err::INVALID_ORDER_SIZE, "Invalid order side" );
 
-    auto order_wrapper_ptr = (order_side == BUY_SIDE) ?
-        buy_order_wrapper_t::get_from_db(_self, _self.value, order_id)
-        : sell_order_wrapper_t::get_from_db(_self, _self.value, order_id);
-    CHECKC( order_wrapper_ptr != nullptr, err::ORDER_NOT_FOUND, "order not found");
-    const auto &order = order_wrapper_ptr->get_order();
+    order_wrapper_t order_wrapper(order_side, _self, _scope_of(order_id), order_id);
+    CHECKC( order_wrapper.exists(), err::ORDER_NOT_FOUND, "order not found");
+    const auto &order = order_wrapper.get_order();
     CHECKC( owner == order.owner, err::NO_AUTH, "have no access to close others' order");
     CHECKC( (order_status_t)order.status == order_status_t::PAUSED, err::ORDER_STATE_NOT_RUNNING, "order not paused" );
-    order_wrapper_ptr->modify(_self, [&]( auto& row ) {
+    _modify_order(order_wrapper, [&]( auto& row ) {
         row.status = (uint8_t)order_status_t::RUNNING;
         row.updated_at = time_point_sec(current_time_point());
     });
@@ -284,14 +604,12 @@ void otcbook::closeorder(const name& owner, const name& order_side, const uint64
     require_auth( owner );
 
     merchant_t merchant(owner);
-    CHECKC( _dbc.get(merchant), err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
+    CHECKC( _get_merchant(merchant), err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
     CHECKC( ORDER_SIDES.count(order_side) != 0, err::INVALID_ORDER_SIZE, "Invalid order side" );
 
-    auto order_wrapper_ptr = (order_side == BUY_SIDE) ?
-        buy_order_wrapper_t::get_from_db(_self, _self.value, order_id)
-        : sell_order_wrapper_t::get_from_db(_self, _self.value, order_id);
-    CHECKC( order_wrapper_ptr != nullptr, err::ORDER_NOT_FOUND, "order not found");
-    const auto &order = order_wrapper_ptr->get_order();
+    order_wrapper_t order_wrapper(order_side, _self, _scope_of(order_id), order_id);
+    CHECKC( order_wrapper.exists(), err::ORDER_NOT_FOUND, "order not found");
+    const auto &order = order_wrapper.get_order();
     CHECKC( owner == order.owner, err::NO_AUTH, "have no access to close others' order");
     CHECKC( (uint8_t)order.status != (uint8_t)order_status_t::CLOSED, err::ORDER_STATE_NOT_CLOSED, "order already closed" );
     CHECKC( order.va_frozen_quantity.amount == 0, err::INVALID_QUANTITY, "order being processed" );
@@ -299,15 +617,122 @@ void otcbook::closeorder(const name& owner, const name& order_side, const uint64
 
     _unfrozen(merchant, order.stake_frozen);
 
-    _dbc.set( merchant , get_self());
+    // no deal is in process, the closed order is reclaimed at once
+    _erase_order(order_wrapper);
+}
+
+void otcbook::migrateorder(const name& order_side, const uint64_t& start_id, const uint64_t& max_rows) {
+    require_auth( _self );
+    CHECKC( ORDER_SIDES.count(order_side) != 0, err::INVALID_ORDER_SIZE, "Invalid order side" );
+    CHECKC( max_rows > 0, err::PARAM_ERROR, "max_rows must be positive" );
+
+    if (order_side == BUY_SIDE) {
+        _migrate_orders<legacy_buy_order_table_t, buy_order_table_t>(order_side, &order_t::by_invprice, start_id, max_rows);
+    } else {
+        _migrate_orders<legacy_sell_order_table_t, sell_order_table_t>(order_side, &order_t::by_price, start_id, max_rows);
+    }
+}
+
+void otcbook::migratedeal(const uint64_t& start_id, const uint64_t& max_rows) {
+    require_auth( _self );
+    CHECKC( max_rows > 0, err::PARAM_ERROR, "max_rows must be positive" );
+
+    // retention longer than the chain age would wrap below zero, move every deal then
+    auto now = current_time_point().sec_since_epoch();
+    bool can_drop = _gstate2.deal_retention_sec > 0 && now > _gstate2.deal_retention_sec;
+    uint64_t expired_at = can_drop ? now - _gstate2.deal_retention_sec : 0;
+    legacy_deal_t::idx_t legacy_deals(_self, _self.value);
+    deal_t::idx_t deals(_self, _self.value);
+
+    auto itr = legacy_deals.lower_bound(start_id);
+    for (uint64_t count = 0; count < max_rows && itr != legacy_deals.end(); count++) {
+        auto deal = deal_t(*itr);
+        itr = legacy_deals.erase(itr);
+        _count_legacy_deal(deal);
+
+        // terminal deals out of retention are dropped instead of moved
+        if (can_drop && deal.by_update_time() < expired_at && deal.is_terminal())
+            continue;
+
+        deals.emplace( _self, [&]( auto& row ) {
+            row = deal;
+        });
+    }
+}
 
-    order_wrapper_ptr->modify(_self, [&]( auto& row ) {
-        row.status = (uint8_t)order_status_t::CLOSED;
-        row.closed_at = time_point_sec(current_time_point());
-        row.updated_at  = time_point_sec(current_time_point());
+deal_t::idx_t::const_iterator otcbook::_find_deal(deal_t::idx_t& deals, const uint64_t& deal_id) {
+    auto deal_itr = deals.find(deal_id);
+    if (deal_itr != deals.end())
+        return deal_itr;
+
+    // move the legacy deal on first access, only the default market has legacy deals
+    if (market_of(deal_id) != default_market_id)
+        return deal_itr;
+    legacy_deal_t::idx_t legacy_deals(_self, _self.value);
+    auto legacy_itr = legacy_deals.find(deal_id);
+    if (legacy_itr == legacy_deals.end())
+        return deal_itr;
+
+    auto deal = deal_t(*legacy_itr);
+    legacy_deals.erase(legacy_itr);
+    _count_legacy_deal(deal);
+    return deals.emplace( _self, [&]( auto& row ) {
+        row = deal;
     });
 }
 
+void otcbook::purgeorders(const name& sender, const uint64_t& market_id, const name& order_side, const uint32_t& max_rows) {
+    _require_admin( sender );
+    CHECKC( ORDER_SIDES.count(order_side) != 0, err::INVALID_ORDER_SIZE, "Invalid order side" );
+    CHECKC( max_rows > 0, err::PARAM_ERROR, "max_rows must be positive" );
+
+    if (order_side == BUY_SIDE) {
+        _purge_orders<buy_order_table_t>(market_id, max_rows);
+    } else {
+        _purge_orders<sell_order_table_t>(market_id, max_rows);
+    }
+}
+
+template<typename table_t>
+void otcbook::_purge_orders(const uint64_t& market_id, const uint32_t& max_rows) {
+    table_t orders(_self, _market_scope(market_id));
+    auto price_idx = orders.template get_index<"price"_n>();
+
+    // untakeable orders, closed ones included, are all at the end of price index
+    auto itr = price_idx.lower_bound((uint128_t)untakeable_price_key << 64);
+    for (uint32_t count = 0; count < max_rows && itr != price_idx.end(); count++) {
+        if ((order_status_t)itr->status == order_status_t::CLOSED && itr->va_frozen_quantity.amount == 0) {
+            itr = price_idx.erase(itr);
+        } else {
+            itr++;
+        }
+    }
+}
+
+template<typename legacy_table_t, typename table_t>
+void otcbook::_migrate_orders(const name& order_side, uint128_t (order_t::*price_key)() const, const uint64_t& start_id, const uint64_t& max_rows) {
+    legacy_table_t legacy_orders(_self, _self.value);
+    table_t orders(_self, _self.value);
+    auto price_idx = orders.template get_index<"price"_n>();
+
+    auto itr = legacy_orders.lower_bound(start_id);
+    for (uint64_t count = 0; count < max_rows && itr != legacy_orders.end(); count++) {
+        auto order = *itr;
+        if (price_idx.find((order.*price_key)()) != price_idx.end()) {
+            itr++;
+            continue;
+        }
+        // re-insert the order to add the missing price index, and count it in depth
+        itr = legacy_orders.erase(itr);
+        orders.emplace( _self, [&]( auto& row ) {
+            row = order;
+        });
+        _update_depth(default_market_id, order_side, order.va_price, asset(0, order.va_quantity.symbol), order.takeable_quantity());
+        if ((order_status_t)order.status != order_status_t::CLOSED)
+            _update_merchant_stats(order.owner, 1, 0, asset(), asset());
+    }
+}
+
 void otcbook::opendeal( const name& taker, const name& order_side, const uint64_t& order_id,
                         const asset& deal_quantity, const uint64_t& order_sn, const name& pay_type) {
     if(order_side == BUY_SIDE) {
@@ -320,14 +745,14 @@ void otcbook::_opendeal( const name& taker, const name& order_side, const uint64
                         const asset& deal_quantity, const uint64_t& order_sn, const name& pay_type) {
     require_auth( taker );
 
-    auto conf = _conf();
-    CHECKC( conf.status == conf_status::RUNNING, err::UNINITIALIZED, "service is in maintenance" );
+    CHECKC( _hot_conf().status == conf_status::RUNNING, err::UNINITIALIZED, "service is in maintenance" );
     CHECKC( ORDER_SIDES.count(order_side) != 0, err::INVALID_ORDER_SIZE, "Invalid order side" );
+    auto market_id = market_of(order_id);
+    _check_market( market_id );
 
-    auto order_wrapper_ptr = (order_side == BUY_SIDE) ? buy_order_wrapper_t::get_from_db(_self, _self.value, order_id)
-                                                      : sell_order_wrapper_t::get_from_db(_self, _self.value, order_id);
-    CHECKC( order_wrapper_ptr != nullptr, err::ORDER_NOT_FOUND, "order not found");
-    const auto &order = order_wrapper_ptr->get_order();
+    order_wrapper_t order_wrapper(order_side, _self, _scope_of(order_id), order_id);
+    CHECKC( order_wrapper.exists(), err::ORDER_NOT_FOUND, "order not found");
+    const auto &order = order_wrapper.get_order();
     CHECKC( order.owner != taker, err::NO_AUTH, "taker cannot be equal to maker" );
     CHECKC( deal_quantity.symbol == order.va_quantity.symbol, err::QUANTITY_SYMBOL_MISMATCH, "Token Symbol mismatch" );
     CHECKC( order.status == (uint8_t)order_status_t::RUNNING, err::ORDER_STATE_NOT_RUNNING, "order not running" );
@@ -336,65 +761,157 @@ void otcbook::_opendeal( const name& taker, const name& order_side, const uint64
     CHECKC( deal_quantity >= order.va_min_take_quantity, err::INVALID_MIN_QUANTITY, "Order's min accept quantity not met!" );
     CHECKC( deal_quantity <= order.va_max_take_quantity, err::INVALID_MAX_QUANTITY, "Order's max accept quantity not met!" );
 
-    auto now                    = current_time_point();
+    _check_blacklist( taker );
+    _check_order_sn( order_sn );
 
+    _create_deal( market_id, order, order_side, taker, deal_quantity, order_sn, pay_type );
+
+    // // 添加交易到期表数据
+    // deal_expiry_tbl deal_expiries(_self, _self.value);
+    // deal_expiries.emplace( _self, [&]( auto& row ){
+    //     row.deal_id = deal_id;
+    //     row.expired_at 			= time_point_sec(created_at.sec_since_epoch() + _gstate.withhold_expire_sec);
+    // });
+
+    _modify_order(order_wrapper, [&]( auto& row ) {
+        row.va_frozen_quantity 	+= deal_quantity;
+        row.updated_at          = current_time_point();
+    });
+}
+
+void otcbook::takebest(const name& taker, const name& order_side, const asset& quantity,
+                        const asset& limit_price, const uint64_t& order_sn, const name& pay_type) {
+    require_auth( taker );
+
+    CHECKC( _hot_conf().status == conf_status::RUNNING, err::UNINITIALIZED, "service is in maintenance" );
+    CHECKC( ORDER_SIDES.count(order_side) != 0, err::INVALID_ORDER_SIZE, "Invalid order side" );
+    if(order_side == BUY_SIDE) {
+        CHECKC( quantity.symbol != USDTARC_SYMBOL, err::QUANTITY_SYMBOL_MISMATCH, "deal quantity must not USDTARC_SYMBOL" )
+    }
+    CHECKC( quantity.is_valid(), err::INVALID_QUANTITY, "Invalid quantity" );
+    CHECKC( quantity.amount > 0, err::QUANTITY_NOT_POSITIVE, "quantity must be positive" );
+    CHECKC( limit_price.is_valid(), err::INVALID_PRICE, "Invalid limit_price" );
+    auto market_id = _route_market(limit_price.symbol, quantity.symbol);
+    _check_market_policy(market_id, order_side, quantity.symbol, {pay_type});
+
+    _check_blacklist( taker );
+    _check_order_sn( order_sn );
+
+    auto taken = (order_side == BUY_SIDE) ?
+        _take_best<buy_order_table_t>(market_id, taker, order_side, quantity, limit_price, order_sn, pay_type)
+        : _take_best<sell_order_table_t>(market_id, taker, order_side, quantity, limit_price, order_sn, pay_type);
+    CHECKC( taken.amount > 0, err::QUANTITY_MISMATCH, "no order can be taken at price: " + limit_price.to_string() );
+}
+
+template<typename table_t>
+asset otcbook::_take_best( const uint64_t& market_id, const name& taker, const name& order_side, const asset& quantity,
+                        const asset& limit_price, const uint64_t& order_sn, const name& pay_type) {
+    table_t orders(_self, _market_scope(market_id));
+    auto price_idx = orders.template get_index<"price"_n>();
+    auto now = current_time_point();
+    auto remaining = quantity;
+
+    auto itr = price_idx.begin();
+    uint64_t taken_count = 0;
+    for (uint64_t scanned = 0; scanned < max_take_best_scan && taken_count < max_take_best_orders
+            && itr != price_idx.end() && remaining.amount > 0; scanned++) {
+        const auto& order = *itr;
+        // the price key of the taken order may change, so move to the next one before taking it
+        auto order_itr = itr++;
+
+        if (!order.can_be_taken()) break;
+        if (order_side == BUY_SIDE ? order.va_price < limit_price : order.va_price > limit_price) break;
+        if (order.va_quantity.symbol != quantity.symbol || order.owner == taker
+            || order.accepted_payments.count(pay_type) == 0) continue;
+
+        auto available = order.va_quantity - order.va_frozen_quantity - order.va_fulfilled_quantity;
+        auto deal_quantity = std::min({ remaining, available, order.va_max_take_quantity });
+        if (deal_quantity < order.va_min_take_quantity) continue;
+
+        _create_deal( market_id, order, order_side, taker, deal_quantity, order_sn, pay_type );
+        taken_count++;
+
+        auto before = order.takeable_quantity();
+        price_idx.modify(order_itr, _self, [&]( auto& row ) {
+            row.va_frozen_quantity 	+= deal_quantity;
+            row.updated_at          = now;
+        });
+        _update_depth(market_id, order_side, order.va_price, before, order.takeable_quantity());
+        remaining -= deal_quantity;
+    }
+    return quantity - remaining;
+}
+
+void otcbook::_check_blacklist( const name& taker ) {
     blacklist_t::idx_t blacklist_tbl( _self, _self.value );
     auto blacklist_itr          = blacklist_tbl.find(taker.value);
-    CHECKC( blacklist_itr == blacklist_tbl.end() || blacklist_itr->expired_at <= now,err::BLACKLISTED, "taker is blacklisted" )
+    CHECKC( blacklist_itr == blacklist_tbl.end() || blacklist_itr->expired_at <= current_time_point(),err::BLACKLISTED, "taker is blacklisted" )
 
-    auto order_price            = order.va_price;
-    auto order_maker            = order.owner;
-    auto merchant_name          = order.merchant_name;
+    _purge_blacklist( blacklist_tbl, max_blacklist_lazy_purge );
+}
 
-    deal_t::idx_t deals(_self, _self.value);
-    auto ordersn_index 			= deals.get_index<"ordersn"_n>();
+/**
+ * order_sn is unique across markets, external apps find deals by it without knowing the market
+ * it is checked once per call, deals opened by one takebest() share it
+ */
+void otcbook::_check_order_sn( const uint64_t& order_sn ) {
+    auto check_market = [&]( const uint64_t& market_id ) {
+        deal_t::idx_t deals(_self, _market_scope(market_id));
+        auto ordersn_index 			= deals.get_index<"ordersn"_n>();
+        CHECKC( ordersn_index.find(order_sn) == ordersn_index.end() ,err::ORDER_EXISTING, "order_sn already existing!" );
+    };
+
+    check_market( default_market_id );
+    legacy_deal_t::idx_t legacy_deals(_self, _self.value);
+    auto legacy_ordersn_index   = legacy_deals.get_index<"ordersn"_n>();
+    CHECKC( legacy_ordersn_index.find(order_sn) == legacy_ordersn_index.end() ,err::ORDER_EXISTING, "order_sn already existing!" );
+
+    // markets are few, at most max_market_id
+    for (const auto& market : _dbc.get_tbl<market_t>(_self.value)) {
+        check_market( market.id );
+    }
+}
 
-    CHECKC( ordersn_index.find(order_sn) == ordersn_index.end() ,err::ORDER_EXISTING, "order_sn already existing!" );
+uint64_t otcbook::_create_deal( const uint64_t& market_id, const order_t& order, const name& order_side, const name& taker,
+                        const asset& deal_quantity, const uint64_t& order_sn, const name& pay_type) {
+    auto now                    = current_time_point();
+
+    deal_t::idx_t deals(_self, _market_scope(market_id));
     auto deal_fee = _calc_deal_fee(deal_quantity);
 
-    auto deal_id = deals.available_primary_key();
-    _gstate.deal_id ++;
+    auto deal_id = _next_deal_id(market_id);
     // deals.emplace( taker, [&]( auto& row ) {
     deals.emplace( _self,       [&]( auto& row ) { //free user from paying ram fees
-        row.id 					= _gstate.deal_id;
-        row.order_side 			= order_side;
-        row.merchant_name       = merchant_name;
-        row.order_id 			= order_id;
-        row.order_price			= order_price;
-        row.deal_quantity		= deal_quantity;
-        row.order_maker			= order_maker;
+        row.id 					= deal_id;
+        row.set_order_side(order_side);
+        row.order_id 			= order.id;
+        row.price               = order.va_price.amount;
+        row.coin_symbol         = deal_quantity.symbol;
+        row.quantity            = deal_quantity.amount;
+        row.order_maker			= order.owner;
         row.order_taker			= taker;
         row.pay_type            = pay_type;
-        row.status				= (uint8_t)deal_status_t::CREATED;
-        row.arbit_status        = (uint8_t)arbit_status_t::UNARBITTED;
+        row.set_status((uint8_t)deal_status_t::CREATED);
+        row.set_arbit_status((uint8_t)arbit_status_t::UNARBITTED);
         row.created_at			= now;
         row.updated_at          = now;
         row.order_sn 			= order_sn;
-        row.deal_fee            = deal_fee;
-    });
-
-    // // 添加交易到期表数据
-    // deal_expiry_tbl deal_expiries(_self, _self.value);
-    // deal_expiries.emplace( _self, [&]( auto& row ){
-    //     row.deal_id = deal_id;
-    //     row.expired_at 			= time_point_sec(created_at.sec_since_epoch() + _gstate.withhold_expire_sec);
-    // });
-
-    order_wrapper_ptr->modify(_self, [&]( auto& row ) {
-        row.va_frozen_quantity 	+= deal_quantity;
-        row.updated_at          = now;
+        row.fee                 = deal_fee.amount;
     });
+    _update_merchant_stats(order.owner, 0, 1, deal_quantity, asset(0, deal_quantity.symbol));
 
     deal_change_info deal_info;
-    deal_info.deal_id       = _gstate.deal_id;
-    deal_info.order_id      = order_id;
+    deal_info.deal_id       = deal_id;
+    deal_info.order_id      = order.id;
     deal_info.order_side    = order_side;
-    deal_info.merchant      = order_maker;
+    deal_info.merchant      = order.owner;
     deal_info.taker         = taker;
     deal_info.status        = (uint8_t)deal_status_t::CREATED;
     deal_info.arbit_status  = (uint8_t)arbit_status_t::UNARBITTED;
     deal_info.quant         = deal_quantity;
-    DEAL_NOTIFY(order_maker, conf.app_info, (uint8_t)deal_action_t::CREATE, deal_info);
+    _notify_deal(order.owner, (uint8_t)deal_action_t::CREATE, deal_info);
+
+    return deal_id;
 }
 
 /**
@@ -407,15 +924,15 @@ void otcbook::closedeal(const name& account, const uint8_t& account_type, const
 }
 
 deal_t otcbook::_closedeal(const name& account, const uint8_t& account_type, const uint64_t& deal_id, const string& close_msg, const bool& by_transfer) {
-    auto conf = _conf();
-    deal_t::idx_t deals(_self, _self.value);
-    auto deal_itr = deals.find(deal_id);
+    const auto& conf = _conf();
+    deal_t::idx_t deals(_self, _scope_of(deal_id));
+    auto deal_itr = _find_deal(deals, deal_id);
     CHECKC( deal_itr != deals.end(),err::ORDER_NOT_FOUND, "deal not found: " + to_string(deal_id) );
-    auto status = (deal_status_t)deal_itr->status;
+    auto status = (deal_status_t)deal_itr->status();
     CHECKC( (uint8_t)status != (uint8_t)deal_status_t::CLOSED,err::ORDER_STATE_CLOSED, "deal already closed: " + to_string(deal_id) );
     CHECKC( (uint8_t)status != (uint8_t)deal_status_t::CANCELLED,err::ORDER_STATE_CANCELLED, "deal already cancelled: " + to_string(deal_id) );
-    auto arbit_status =  (arbit_status_t)deal_itr->arbit_status;
-    auto merchant_paid_at = deal_itr->merchant_paid_at;
+    auto arbit_status =  (arbit_status_t)deal_itr->arbit_status();
+    auto merchant_paid_at = deal_itr->merchant_paid_at();
 
     switch ((account_type_t) account_type) {
     case account_type_t::USER:
@@ -432,7 +949,7 @@ deal_t otcbook::_closedeal(const name& account, const uint8_t& account_type, con
         CHECKC( deal_itr->order_maker == account, err::NO_AUTH, "merchant account mismatched");
         CHECKC( (uint8_t)status == (uint8_t)deal_status_t::MAKER_RECV_AND_SENT || 
             (uint8_t)status == (uint8_t)deal_status_t::TAKER_SENT,err::ORDER_STATE_MISMATCH, "can only close deal in status taker_sent or maker_recv");
-        CHECKC( by_transfer || (merchant_paid_at + seconds(_conf().payed_timeout) < current_time_point()),err::TIME_NOT_EXPIRED, "deal is not expired.");
+        CHECKC( by_transfer || (merchant_paid_at + seconds(_hot_conf().payed_timeout) < current_time_point()),err::TIME_NOT_EXPIRED, "deal is not expired.");
         break;
     default:
         CHECKC(false, err::ACCCOUNT_TYPE_MISMATCH, "account type not supported: " + to_string(account_type));
@@ -440,20 +957,18 @@ deal_t otcbook::_closedeal(const name& account, const uint8_t& account_type, con
     }
 
     auto order_id = deal_itr->order_id;
-    auto order_wrapper_ptr = (deal_itr->order_side == BUY_SIDE) ?
-        buy_order_wrapper_t::get_from_db(_self, _self.value, order_id)
-        : sell_order_wrapper_t::get_from_db(_self, _self.value, order_id);
-    CHECKC( order_wrapper_ptr != nullptr, err::ORDER_NOT_FOUND, "order not found");
-    const auto &order = order_wrapper_ptr->get_order();
+    order_wrapper_t order_wrapper(deal_itr->order_side(), _self, _scope_of(order_id), order_id);
+    CHECKC( order_wrapper.exists(), err::ORDER_NOT_FOUND, "order not found");
+    const auto &order = order_wrapper.get_order();
 
     CHECKC( (uint8_t)order.status != (uint8_t)order_status_t::CLOSED,err::ORDER_STATE_CLOSED, "order already closed" );
 
     auto action = deal_action_t::CLOSE;
     const auto &order_maker  = deal_itr->order_maker;
 
-    auto deal_quantity = deal_itr->deal_quantity;
+    auto deal_quantity = deal_itr->deal_quantity();
     CHECKC( order.va_frozen_quantity >= deal_quantity,err::INVALID_QUANTITY, "Err: order frozen quantity smaller than deal quantity" );
-    auto deal_fee= deal_itr->deal_fee;
+    auto deal_fee= deal_itr->deal_fee(_hot_conf().stake_coin(deal_itr->coin_symbol));
 
     if ((account_type_t) account_type == account_type_t::MERCHANT || (account_type_t) account_type == account_type_t::USER) {
         CHECKC( deal_status_t::MAKER_RECV_AND_SENT == status || (deal_status_t::TAKER_SENT == status && by_transfer), 
@@ -465,39 +980,49 @@ deal_t otcbook::_closedeal(const name& account, const uint8_t& account_type, con
     auto now                        = current_time_point();
     auto stake_quantity             = _calc_order_stakes(deal_quantity);
 
-    order_wrapper_ptr->modify(_self, [&]( auto& row ) {
-        row.stake_frozen            -= stake_quantity;
-        row.va_frozen_quantity      -= deal_quantity;
-        row.va_fulfilled_quantity   += deal_quantity;
-        row.updated_at              = now;
-        if(row.stake_frozen.amount == 0 && row.va_frozen_quantity.amount == 0){
-            row.status = (uint8_t)order_status_t::CLOSED;
-            row.closed_at = now;
-        }
-    });
+    if (order.stake_frozen == stake_quantity && order.va_frozen_quantity == deal_quantity) {
+        // last deal of the order is closed, the closed order is reclaimed at once
+        _erase_order(order_wrapper);
+    } else {
+        _modify_order(order_wrapper, [&]( auto& row ) {
+            row.stake_frozen            -= stake_quantity;
+            row.va_frozen_quantity      -= deal_quantity;
+            row.va_fulfilled_quantity   += deal_quantity;
+            row.updated_at              = now;
+        });
+    }
+    _update_merchant_stats(order_maker, 0, -1, -deal_quantity, deal_quantity);
+
+    // closing an arbiting deal ends its arbitration without fine
+    auto arbiting = deal_itr->arbit_status() == (uint8_t)arbit_status_t::ARBITING;
+    if (arbiting)
+        _close_case( deal_itr->arbiter );
 
     deals.modify( *deal_itr, _self, [&]( auto& row ) {
-        row.status                  = (uint8_t)deal_status_t::CLOSED;
-        row.closed_at               = now;
+        if (arbiting)
+            row.set_arbit_status((uint8_t)arbit_status_t::CLOSENOFINE);
+        row.set_status((uint8_t)deal_status_t::CLOSED);
         row.updated_at              = now;
-        row.close_msg               = close_msg;
+        row.close_msg               = close_msg.substr(0, max_close_msg_size);
     });
 
     merchant_t merchant(order_maker);
-    CHECKC( _dbc.get(merchant), err::ACCOUNT_NOT_FOUND,"merchant not found: " + order_maker.to_string() );
+    CHECKC( _get_merchant(merchant), err::ACCOUNT_NOT_FOUND,"merchant not found: " + order_maker.to_string() );
     _unfrozen(merchant, stake_quantity);
 
     if ( deal_fee.amount > 0) {
         _sub_balance(merchant, deal_fee, "fee:"+to_string(deal_id));
-        TRANSFER( MBANK, _gstate.token_split_contract, deal_fee, std::string("plan:") + to_string( _gstate.token_split_plan_id) + ":" + to_string(deal_fee.amount) )
+        _accrue_fee(deal_fee);
     }
 
-    auto fee = deal_itr->deal_fee;
-    auto deal_amount = _calc_deal_amount(deal_itr->deal_quantity);
-    auto settle_arc = conf.managers.at(otc::manager_type::settlement);
+    auto fee = deal_itr->deal_fee(_hot_conf().stake_coin(deal_itr->coin_symbol));
+    auto deal_amount = _calc_deal_amount(deal_itr->deal_quantity());
+    auto settle_arc = conf.manager(otc::manager_type::settlement);
 
-    if (deal_amount.symbol == STAKE_USDT) {
-        if (is_account(settle_arc)) {
+    if (deal_amount.symbol == STAKE_USDT && is_account(settle_arc)) {
+        if (_gstate2.settle_async) {
+            _queue_settle(settle_arc, *deal_itr, deal_amount, fee);
+        } else {
             SETTLE_DEAL(settle_arc,
                         _self,
                         deal_id, 
@@ -507,7 +1032,7 @@ deal_t otcbook::_closedeal(const name& account, const uint8_t& account_type, con
                         fee,
                         0, 
                         deal_itr->created_at, 
-                        deal_itr->closed_at);
+                        deal_itr->closed_at());
         }
     }
 
@@ -516,11 +1041,11 @@ deal_t otcbook::_closedeal(const name& account, const uint8_t& account_type, con
 void otcbook::canceldeal(const name& account, const uint8_t& account_type, const uint64_t& deal_id, bool is_taker_black) {
     require_auth( account );
 
-    deal_t::idx_t deals(_self, _self.value);
-    auto deal_itr = deals.find(deal_id);
+    deal_t::idx_t deals(_self, _scope_of(deal_id));
+    auto deal_itr = _find_deal(deals, deal_id);
     CHECKC( deal_itr != deals.end(),err::ORDER_NOT_FOUND, "deal not found: " + to_string(deal_id) );
-    auto status = (deal_status_t)deal_itr->status;
-    auto arbit_status =  (arbit_status_t)deal_itr->arbit_status;
+    auto status = (deal_status_t)deal_itr->status();
+    auto arbit_status =  (arbit_status_t)deal_itr->arbit_status();
     auto now = current_time_point();
 
     switch ((account_type_t) account_type) {
@@ -529,8 +1054,8 @@ void otcbook::canceldeal(const name& account, const uint8_t& account_type, const
             case deal_status_t::CREATED:
                 break;
             case deal_status_t::MAKER_ACCEPTED: {
-                auto merchant_accepted_at = deal_itr->merchant_accepted_at;
-                CHECKC(merchant_accepted_at + seconds(_conf().accepted_timeout) < now, err::TIME_NOT_EXPIRED, "deal is not expired.");
+                auto merchant_accepted_at = deal_itr->merchant_accepted_at();
+                CHECKC(merchant_accepted_at + seconds(_hot_conf().accepted_timeout) < now, err::TIME_NOT_EXPIRED, "deal is not expired.");
                 break;
             }
             default:
@@ -543,8 +1068,8 @@ void otcbook::canceldeal(const name& account, const uint8_t& account_type, const
             case deal_status_t::CREATED:
                 break;
             case deal_status_t::MAKER_ACCEPTED: {
-                auto merchant_accepted_at = deal_itr->merchant_accepted_at;
-                CHECKC(merchant_accepted_at + seconds(_conf().accepted_timeout) < now, err::TIME_NOT_EXPIRED, "deal is not expired.");
+                auto merchant_accepted_at = deal_itr->merchant_accepted_at();
+                CHECKC(merchant_accepted_at + seconds(_hot_conf().accepted_timeout) < now, err::TIME_NOT_EXPIRED, "deal is not expired.");
                 if (is_taker_black)
                     _set_blacklist(deal_itr->order_taker, default_blacklist_duration_second, get_self());
                 break;
@@ -567,58 +1092,89 @@ void otcbook::canceldeal(const name& account, const uint8_t& account_type, const
         break;
     }
 
+    _cancel_deal(deals, deal_itr, (account_type_t)account_type == account_type_t::USER);
+
+    blacklist_t::idx_t blacklist_tbl(_self, _self.value);
+    _purge_blacklist( blacklist_tbl, max_blacklist_lazy_purge );
+}
+
+void otcbook::timeoutdeal(const uint64_t& market_id, const uint32_t& max_rows) {
+    CHECKC( max_rows > 0, err::NOT_POSITIVE, "max_rows must be positive" )
+
+    auto now = current_time_point().sec_since_epoch();
+    auto timeout = _hot_conf().accepted_timeout;
+    if (now <= timeout) return;     // no deal can be expired yet
+
+    deal_t::idx_t deals(_self, _market_scope(market_id));
+    auto deadline_idx = deals.get_index<"deadline"_n>();
+    auto itr = deadline_idx.begin();
+    for (uint32_t count = 0; count < max_rows && itr != deadline_idx.end() && itr->by_deadline() < now - timeout; count++) {
+        auto deal_itr = deals.iterator_to(*itr);
+        itr++;
+        // deals of missing or closed orders are left to canceldeal by admin, which reports why
+        order_wrapper_t order_wrapper(deal_itr->order_side(), _self, _scope_of(deal_itr->order_id), deal_itr->order_id);
+        if (!order_wrapper.exists() || order_wrapper.get_order().status == (uint8_t)order_status_t::CLOSED)
+            continue;
+        _cancel_deal(deals, deal_itr, order_wrapper, false);
+    }
+}
+
+void otcbook::_cancel_deal(deal_t::idx_t& deals, deal_t::idx_t::const_iterator deal_itr, const bool& pause_order) {
     auto order_id = deal_itr->order_id;
-    auto order_wrapper_ptr = (deal_itr->order_side == BUY_SIDE) ?
-        buy_order_wrapper_t::get_from_db(_self, _self.value, order_id)
-        : sell_order_wrapper_t::get_from_db(_self, _self.value, order_id);
-    CHECKC( order_wrapper_ptr != nullptr, err::ORDER_NOT_FOUND, "order not found");
-    const auto &order = order_wrapper_ptr->get_order();
+    order_wrapper_t order_wrapper(deal_itr->order_side(), _self, _scope_of(order_id), order_id);
+    CHECKC( order_wrapper.exists(), err::ORDER_NOT_FOUND, "order not found");
+    CHECKC( (uint8_t)order_wrapper.get_order().status != (uint8_t)order_status_t::CLOSED,err::ORDER_STATE_CLOSED, "order already closed" );
 
-    CHECKC( (uint8_t)order.status != (uint8_t)order_status_t::CLOSED,err::ORDER_STATE_CLOSED, "order already closed" );
+    _cancel_deal(deals, deal_itr, order_wrapper, pause_order);
+}
+
+void otcbook::_cancel_deal(deal_t::idx_t& deals, deal_t::idx_t::const_iterator deal_itr, order_wrapper_t& order_wrapper, const bool& pause_order) {
+    const auto &order = order_wrapper.get_order();
 
     auto order_status  = order.status;
     auto limit_seconds = seconds(deal_expired_second);
-    if((account_type_t)account_type == account_type_t::USER) {
+    if(pause_order) {
         if ((((time_point_sec(current_time_point())) - deal_itr->updated_at) > limit_seconds )  
             && (order.status == (uint8_t)order_status_t::RUNNING )){
             order_status = (uint8_t)order_status_t::PAUSED;
         }
     }
 
+    if (deal_itr->arbit_status() == (uint8_t)arbit_status_t::ARBITING)
+        _close_case( deal_itr->arbiter );
+
     deals.modify( *deal_itr, _self, [&]( auto& row ) {
-            row.arbit_status = (uint8_t)arbit_status_t::UNARBITTED;
-            row.status = (uint8_t)deal_status_t::CANCELLED;
-            row.closed_at = time_point_sec(current_time_point());
+            row.set_arbit_status((uint8_t)arbit_status_t::UNARBITTED);
+            row.set_status((uint8_t)deal_status_t::CANCELLED);
             row.updated_at = time_point_sec(current_time_point());
             row.close_msg = "cancel deal";
         });
 
-    auto deal_quantity = deal_itr->deal_quantity;
+    auto deal_quantity = deal_itr->deal_quantity();
 
 
     // finished deal-canceled
-    order_wrapper_ptr->modify(_self, [&]( auto& row ) {
+    _modify_order(order_wrapper, [&]( auto& row ) {
         row.va_frozen_quantity -= deal_quantity;
         row.updated_at = time_point_sec(current_time_point());
         row.status = order_status;
     });
+    _update_merchant_stats(deal_itr->order_maker, 0, -1, -deal_quantity, asset(0, deal_quantity.symbol));
     
-    if (deal_itr->deal_quantity.symbol == USDTARC_SYMBOL && deal_itr->order_side == BUY_SIDE) {
-        auto deal_quantity = deal_itr->deal_quantity;
+    if (deal_itr->deal_quantity().symbol == USDTARC_SYMBOL && deal_itr->order_side() == BUY_SIDE) {
+        auto deal_quantity = deal_itr->deal_quantity();
         deal_quantity.symbol = MUSDT_SYMBOL;
         _transfer_usdt(deal_itr->order_taker, deal_quantity, deal_itr->id);
     }
 }
 
 deal_t otcbook::_process(const name& account, const uint8_t& account_type, const uint64_t& deal_id, uint8_t action_type) {
-    deal_t::idx_t deals(_self, _self.value);
-    auto deal_itr = deals.find(deal_id);
+    deal_t::idx_t deals(_self, _scope_of(deal_id));
+    auto deal_itr = _find_deal(deals, deal_id);
     CHECKC( deal_itr != deals.end(), err::ORDER_NOT_FOUND, "deal not found: " + to_string(deal_id) );
 
-    auto order_wrapper_ptr = ( deal_itr->order_side == BUY_SIDE ) ?
-        buy_order_wrapper_t::get_from_db( _self, _self.value, deal_itr->order_id )
-        : sell_order_wrapper_t::get_from_db( _self, _self.value, deal_itr->order_id) ;
-    CHECKC( order_wrapper_ptr != nullptr,err::ORDER_NOT_FOUND, "order not found" );
+    order_wrapper_t order_wrapper(deal_itr->order_side(), _self, _scope_of(deal_itr->order_id), deal_itr->order_id);
+    CHECKC( order_wrapper.exists(),err::ORDER_NOT_FOUND, "order not found" );
 
     auto now = time_point_sec(current_time_point());
     switch ((account_type_t) account_type) {
@@ -637,8 +1193,8 @@ deal_t otcbook::_process(const name& account, const uint8_t& account_type, const
         break;
     }
 
-    auto status = (deal_status_t)deal_itr->status;
-    auto arbit_status = (arbit_status_t)deal_itr->arbit_status;
+    auto status = (deal_status_t)deal_itr->status();
+    auto arbit_status = (arbit_status_t)deal_itr->arbit_status();
     deal_status_t limited_status = deal_status_t::NONE;
     account_type_t limited_account_type = account_type_t::NONE;
     arbit_status_t limit_arbit_status = arbit_status_t::UNARBITTED;
@@ -663,11 +1219,11 @@ deal_t otcbook::_process(const name& account, const uint8_t& account_type, const
             check(false, "unsupported process deal action:" + to_string((uint8_t)action_type));
             break;
     }
-    if (deal_itr->deal_quantity.symbol == USDTARC_SYMBOL && next_status == deal_status_t::MAKER_ACCEPTED && deal_itr->order_side == BUY_SIDE) {
+    if (deal_itr->deal_quantity().symbol == USDTARC_SYMBOL && next_status == deal_status_t::MAKER_ACCEPTED && deal_itr->order_side() == BUY_SIDE) {
         next_status = deal_status_t::TAKER_SENT;
         asset deal_quantity;
         deal_quantity.symbol = MUSDT_SYMBOL;
-        deal_quantity.amount = deal_itr->deal_quantity.amount;
+        deal_quantity.amount = deal_itr->deal_quantity().amount;
         _transfer_usdt(deal_itr->order_maker, deal_quantity, deal_itr->id);
     }
 
@@ -686,14 +1242,14 @@ deal_t otcbook::_process(const name& account, const uint8_t& account_type, const
 
     deals.modify( *deal_itr, _self, [&]( auto& row ) {
         if (next_status != deal_status_t::NONE) {
-            row.status = (uint8_t)next_status;
+            row.set_status((uint8_t)next_status);
             row.updated_at = time_point_sec(current_time_point());
         }
         if((uint8_t)deal_action_t::MAKER_ACCEPT == action_type) {
-            row.merchant_accepted_at = time_point_sec(current_time_point());
+            row.set_merchant_accepted_at(time_point_sec(current_time_point()));
         }
         if((uint8_t)deal_action_t::MAKER_RECV_AND_SENT == action_type ) {
-            row.merchant_paid_at = time_point_sec(current_time_point());
+            row.set_merchant_paid_at(time_point_sec(current_time_point()));
         }
     });
 
@@ -702,16 +1258,16 @@ deal_t otcbook::_process(const name& account, const uint8_t& account_type, const
         deal_change_info deal_info;
         deal_info.deal_id       = deal_itr->id;
         deal_info.order_id      = deal_itr->order_id;
-        deal_info.order_side    = deal_itr->order_side;
+        deal_info.order_side    = deal_itr->order_side();
         deal_info.merchant      = deal_itr->order_maker;
         deal_info.taker         = deal_itr->order_taker;
-        deal_info.status        = deal_itr->status;
-        deal_info.arbit_status  = deal_itr->arbit_status;
-        deal_info.quant         = deal_itr->deal_quantity;
+        deal_info.status        = deal_itr->status();
+        deal_info.arbit_status  = deal_itr->arbit_status();
+        deal_info.quant         = deal_itr->deal_quantity();
         if ( account_type == (uint8_t)account_type_t::MERCHANT ) {
-            DEAL_NOTIFY(deal_itr->order_taker, _conf().app_info, action_type, deal_info);
+            _notify_deal(deal_itr->order_taker, action_type, deal_info);
         } else {
-            DEAL_NOTIFY(deal_itr->order_maker, _conf().app_info, action_type, deal_info);
+            _notify_deal(deal_itr->order_maker, action_type, deal_info);
         }
     }
 
@@ -727,14 +1283,12 @@ void otcbook::processdeal(const name& account, const uint8_t& account_type, cons
 void otcbook::startarbit(const name& account, const uint8_t& account_type, const uint64_t& deal_id) {
     require_auth( account );
 
-    deal_t::idx_t deals(_self, _self.value);
-    auto deal_itr = deals.find(deal_id);
+    deal_t::idx_t deals(_self, _scope_of(deal_id));
+    auto deal_itr = _find_deal(deals, deal_id);
     CHECKC( deal_itr != deals.end(), err::ORDER_NOT_FOUND, "deal not found: " + to_string(deal_id) );
 
-    auto order_wrapper_ptr = (deal_itr->order_side == BUY_SIDE) ?
-        buy_order_wrapper_t::get_from_db(_self, _self.value, deal_itr->order_id)
-        : sell_order_wrapper_t::get_from_db(_self, _self.value, deal_itr->order_id);
-    CHECKC( order_wrapper_ptr != nullptr, err::ORDER_NOT_FOUND , "order not found");
+    order_wrapper_t order_wrapper(deal_itr->order_side(), _self, _scope_of(deal_itr->order_id), deal_itr->order_id);
+    CHECKC( order_wrapper.exists(), err::ORDER_NOT_FOUND , "order not found");
 
     auto now = time_point_sec(current_time_point());
 
@@ -750,17 +1304,16 @@ void otcbook::startarbit(const name& account, const uint8_t& account_type, const
         break;
     }
 
-    auto arbiter = name(0);
-    _rand_arbiter( deal_id, arbiter );
-    auto status = (deal_status_t)deal_itr->status;
-    auto arbit_status = (arbit_status_t)deal_itr->arbit_status;
+    auto status = (deal_status_t)deal_itr->status();
+    auto arbit_status = (arbit_status_t)deal_itr->arbit_status();
     CHECKC( arbit_status == arbit_status_t::UNARBITTED , err::ORDER_STATE_UNARBITTED, "arbit already started: " + to_string(deal_id) );
 
     set<deal_status_t> can_arbit_status = {deal_status_t::MAKER_ACCEPTED, deal_status_t::TAKER_SENT, deal_status_t::MAKER_RECV_AND_SENT };
     CHECKC( can_arbit_status.count(status) != 0, err::ORDER_STATE_MISMATCH,"status illegal: " + to_string((uint8_t)status) );
+    auto arbiter = _pick_arbiter();
 
     deals.modify( *deal_itr, _self, [&]( auto& row ) {
-        row.arbit_status = (uint8_t)arbit_status_t::ARBITING;
+        row.set_arbit_status((uint8_t)arbit_status_t::ARBITING);
         row.arbiter = arbiter;
         row.updated_at = time_point_sec(current_time_point());
        });
@@ -769,20 +1322,18 @@ void otcbook::startarbit(const name& account, const uint8_t& account_type, const
 void otcbook::closearbit(const name& account, const uint64_t& deal_id, const uint8_t& arbit_result) {
     require_auth( account );
 
-    deal_t::idx_t deals(_self, _self.value);
-    auto deal_itr = deals.find(deal_id);
+    deal_t::idx_t deals(_self, _scope_of(deal_id));
+    auto deal_itr = _find_deal(deals, deal_id);
     CHECKC( deal_itr != deals.end(), err::ORDER_NOT_FOUND, "deal not found: " + to_string(deal_id) );
 
-    auto order_wrapper_ptr = (deal_itr->order_side == BUY_SIDE) ?
-        buy_order_wrapper_t::get_from_db(_self, _self.value, deal_itr->order_id)
-        : sell_order_wrapper_t::get_from_db(_self, _self.value, deal_itr->order_id);
-    CHECKC( order_wrapper_ptr != nullptr, err::ORDER_NOT_FOUND, "order not found");
+    order_wrapper_t order_wrapper(deal_itr->order_side(), _self, _scope_of(deal_itr->order_id), deal_itr->order_id);
+    CHECKC( order_wrapper.exists(), err::ORDER_NOT_FOUND, "order not found");
 
     auto now = time_point_sec(current_time_point());
     CHECKC( deal_itr->arbiter == account, err::NO_AUTH , "arbiter account mismatched");
 
-    auto status = (deal_status_t)deal_itr->status;
-    auto arbit_status = (arbit_status_t)deal_itr->arbit_status;
+    auto status = (deal_status_t)deal_itr->status();
+    auto arbit_status = (arbit_status_t)deal_itr->arbit_status();
     const auto &order_taker  = deal_itr->order_taker;
     const auto &order_maker  = deal_itr->order_maker;
     CHECKC( arbit_status == arbit_status_t::ARBITING, err::ORDER_STATE_NOT_ARBITING, "arbit isn't arbiting: " + to_string(deal_id) );
@@ -793,46 +1344,51 @@ void otcbook::closearbit(const name& account, const uint64_t& deal_id, const uin
     }
 
     deals.modify( *deal_itr, _self, [&]( auto& row ) {
-            row.arbit_status = uint8_t(arbit_result == 0 ? arbit_status_t::CLOSENOFINE : arbit_status_t::CLOSEWITHFINE );
-            row.status = (uint8_t)deal_status_t::CLOSED;
-            row.closed_at = time_point_sec(current_time_point());
+            row.set_arbit_status(uint8_t(arbit_result == 0 ? arbit_status_t::CLOSENOFINE : arbit_status_t::CLOSEWITHFINE ));
+            row.set_status((uint8_t)deal_status_t::CLOSED);
             row.updated_at = time_point_sec(current_time_point());
         });
 
-    auto deal_quantity = deal_itr->deal_quantity;
-    auto deal_fee = deal_itr->deal_fee;
-    auto deal_price = deal_itr->order_price;
+    auto deal_quantity = deal_itr->deal_quantity();
     auto deal_amount = _calc_deal_amount(deal_quantity);
     auto order_id = deal_itr->order_id;
 
     if (arbit_result == 0) {
         // finished deal-canceled
-        order_wrapper_ptr->modify(_self, [&]( auto& row ) {
+        _modify_order(order_wrapper, [&]( auto& row ) {
             row.va_frozen_quantity -= deal_quantity;
             row.updated_at = time_point_sec(current_time_point());
         });
+        _update_merchant_stats(order_maker, 0, -1, -deal_quantity, asset(0, deal_quantity.symbol));
 
         _update_arbiter_info(account, deal_quantity, false);
 
     } else {
         // end deal - finished
         auto stake_quantity = _calc_order_stakes(deal_quantity);
-        order_wrapper_ptr->modify(_self, [&]( auto& row ) {
-            row.stake_frozen -= stake_quantity;
-            row.va_frozen_quantity -= deal_quantity;
-            row.va_fulfilled_quantity += deal_quantity;
-            row.updated_at = time_point_sec(current_time_point());
-        });
+        const auto &order = order_wrapper.get_order();
+        if (order.stake_frozen == stake_quantity && order.va_frozen_quantity == deal_quantity) {
+            // last deal of the order is closed, the closed order is reclaimed at once, see _closedeal()
+            _erase_order(order_wrapper);
+        } else {
+            _modify_order(order_wrapper, [&]( auto& row ) {
+                row.stake_frozen -= stake_quantity;
+                row.va_frozen_quantity -= deal_quantity;
+                row.va_fulfilled_quantity += deal_quantity;
+                row.updated_at = time_point_sec(current_time_point());
+            });
+        }
+        _update_merchant_stats(order_maker, 0, -1, -deal_quantity, deal_quantity);
 
         //sub arbit fine
         merchant_t merchant(order_maker);
-        CHECKC( _dbc.get(merchant),err::ACCOUNT_NOT_FOUND, "merchant not found: " + order_maker.to_string() );
+        CHECKC( _get_merchant(merchant),err::ACCOUNT_NOT_FOUND, "merchant not found: " + order_maker.to_string() );
         _unfrozen(merchant, stake_quantity);
         _sub_balance(merchant, stake_quantity, "arbit fine:"+to_string(deal_id));
 
         //refund
 
-        TRANSFER(_conf().stake_assets_contract.at(stake_quantity.symbol), order_taker, 
+        TRANSFER(_conf().stake_contract(stake_quantity.symbol), order_taker, 
         stake_quantity, "arbit fine: "+to_string(deal_id));
         _update_arbiter_info(account, deal_quantity, true);
    }
@@ -842,13 +1398,13 @@ void otcbook::cancelarbit( const uint8_t& account_type, const name& account, con
 {
     require_auth( account );
 
-    deal_t::idx_t deals(_self, _self.value);
-    auto deal_itr = deals.find(deal_id);
+    deal_t::idx_t deals(_self, _scope_of(deal_id));
+    auto deal_itr = _find_deal(deals, deal_id);
     CHECKC( deal_itr != deals.end(),err::ORDER_NOT_FOUND, "deal not found: " + to_string(deal_id) );
-    auto arbit_status = (arbit_status_t)deal_itr->arbit_status;
+    auto arbit_status = (arbit_status_t)deal_itr->arbit_status();
 
     CHECKC( arbit_status == arbit_status_t::ARBITING,err::ORDER_STATE_NOT_ARBITING, "deal is not arbiting" );
-    auto status = deal_itr->status;
+    auto status = deal_itr->status();
 
     switch ((account_type_t) account_type) {
     case account_type_t::MERCHANT:
@@ -865,9 +1421,11 @@ void otcbook::cancelarbit( const uint8_t& account_type, const name& account, con
         break;
     }
 
+    _close_case( deal_itr->arbiter );
+
     auto now = time_point_sec(current_time_point());
     deals.modify( *deal_itr, _self, [&]( auto& row ) {
-        row.arbit_status = (uint8_t)arbit_status_t::UNARBITTED;
+        row.set_arbit_status((uint8_t)arbit_status_t::UNARBITTED);
         row.updated_at = now;
     });
 
@@ -879,31 +1437,31 @@ void otcbook::resetdeal(const name& account, const uint64_t& deal_id){
 
     // CHECK( _conf().managers.at(otc::manager_type::admin) == account, "Only admin allowed" );
 
-    deal_t::idx_t deals(_self, _self.value);
-    auto deal_itr = deals.find(deal_id);
+    deal_t::idx_t deals(_self, _scope_of(deal_id));
+    auto deal_itr = _find_deal(deals, deal_id);
     CHECKC( deal_itr != deals.end(), err::ORDER_NOT_FOUND,"deal not found: " + to_string(deal_id) );
 
-    auto status = (deal_status_t)deal_itr->status;
+    auto status = (deal_status_t)deal_itr->status();
     CHECKC( status != deal_status_t::CLOSED,err::ORDER_STATE_CLOSED, "deal already closed: " + to_string(deal_id) );
     CHECKC( status != deal_status_t::CREATED, err::ORDER_STATE_CREATED, "deal no need to reverse" );
 
     auto now = time_point_sec(current_time_point());
     deals.modify( *deal_itr, _self, [&]( auto& row ) {
-        row.status = (uint8_t)deal_status_t::CREATED;
+        row.set_status((uint8_t)deal_status_t::CREATED);
         row.updated_at = time_point_sec(current_time_point());
     });
 }
 
 void otcbook::withdraw(const name& owner, asset quantity){
-    auto conf = _conf();
-    CHECKC( conf.status == conf_status::RUNNING,err::UNINITIALIZED, "service is in maintenance" );
+    const auto& conf = _conf();
+    CHECKC( _hot_conf().status == conf_status::RUNNING,err::UNINITIALIZED, "service is in maintenance" );
     CHECKC( has_auth(owner) || has_auth(_self),err::NO_AUTH, "neither owner nor self" );
     CHECKC( quantity.amount > 0, err::QUANTITY_NOT_POSITIVE, "quanity must be positive" );
     CHECKC( quantity.symbol.is_valid(), err::QUANTITY_SYMBOL_MISMATCH, "Invalid quantity symbol name" );
-    CHECKC( _conf().stake_assets_contract.count(quantity.symbol), err::QUANTITY_SYMBOL_MISMATCH, "Token Symbol not allowed" );
+    CHECKC( conf.has_stake_contract(quantity.symbol), err::QUANTITY_SYMBOL_MISMATCH, "Token Symbol not allowed" );
 
     merchant_t merchant(owner);
-    CHECKC( _dbc.get(merchant),err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
+    CHECKC( _get_merchant(merchant),err::ACCOUNT_NOT_FOUND, "merchant not found: " + owner.to_string() );
     auto state = (merchant_status_t)merchant.status;
     CHECKC(state >= merchant_status_t::BASIC || state == merchant_status_t::DISABLED,err::ACCOUNT_STATE_MISMATCH, "merchant not enabled");
 
@@ -926,13 +1484,13 @@ void otcbook::withdraw(const name& owner, asset quantity){
 
     _sub_balance(merchant, quantity, "merchant withdraw");
 
-    TRANSFER( _conf().stake_assets_contract.at(quantity.symbol), owner, quantity, "merchant withdraw" )
+    TRANSFER( conf.stake_contract(quantity.symbol), owner, quantity, "merchant withdraw" )
 }
 
 void otcbook::ontransfer(name from, name to, asset quantity, string memo){
     if(_self == from || to != _self) return;
-    CHECKC( _conf().stake_assets_contract.count(quantity.symbol),err::QUANTITY_SYMBOL_MISMATCH, "Token Symbol not allowed" );
-    CHECKC( _conf().stake_assets_contract.at(quantity.symbol) == get_first_receiver(),err::QUANTITY_SYMBOL_NOT_ALLOW, "Token Symbol not allowed" );
+    CHECKC( _conf().has_stake_contract(quantity.symbol),err::QUANTITY_SYMBOL_MISMATCH, "Token Symbol not allowed" );
+    CHECKC( _conf().stake_contract(quantity.symbol) == get_first_receiver(),err::QUANTITY_SYMBOL_NOT_ALLOW, "Token Symbol not allowed" );
   
     if(memo.empty()){
         _deposit(from, to, quantity, memo);
@@ -963,11 +1521,11 @@ void otcbook::ontransfer(name from, name to, asset quantity, string memo){
 void otcbook::_deposit(name from, name to, asset quantity, string memo) {
     if(_self == from || to != _self) return;
 
-    CHECKC( _conf().stake_assets_contract.count(quantity.symbol),err::QUANTITY_SYMBOL_MISMATCH, "Token Symbol not allowed: " + quantity.to_string() );
-    CHECKC( _conf().stake_assets_contract.at(quantity.symbol) == get_first_receiver(),err::QUANTITY_SYMBOL_NOT_ALLOW, "Token Contract not allowed: " 
-                                                + _conf().stake_assets_contract.at(quantity.symbol).to_string() );
+    CHECKC( _conf().has_stake_contract(quantity.symbol),err::QUANTITY_SYMBOL_MISMATCH, "Token Symbol not allowed: " + quantity.to_string() );
+    CHECKC( _conf().stake_contract(quantity.symbol) == get_first_receiver(),err::QUANTITY_SYMBOL_NOT_ALLOW, "Token Contract not allowed: " 
+                                                + _conf().stake_contract(quantity.symbol).to_string() );
     merchant_t merchant(from);
-    CHECKC(_dbc.get( merchant ),err::ACCOUNT_NOT_FOUND,"merchant is not set, from:" + from.to_string()+ ",to:" + to.to_string());
+    CHECKC(_get_merchant(merchant),err::ACCOUNT_NOT_FOUND,"merchant is not set, from:" + from.to_string()+ ",to:" + to.to_string());
     CHECKC((merchant_status_t)merchant.status >= merchant_status_t::BASIC,err::ACCOUNT_STATE_MISMATCH,
         "merchant not enabled");
     _add_balance(merchant, quantity, "merchant deposit");
@@ -984,14 +1542,56 @@ void otcbook::setblacklist(const name& from, const name& account, uint64_t durat
    _set_blacklist(account, duration_second, from);
 }
 
-const fiat_conf_t& otcbook::_conf(bool refresh/* = false*/) {
-    
+/**
+ * conf digest pushed by conf contract is used if its version is current,
+ * otherwise digest the conf of conf contract and save it
+ */
+const conf_digest_t& otcbook::_conf(bool refresh/* = false*/) {
+    if (_conf_ptr && !refresh) return *_conf_ptr;
+
     CHECKC(_gstate.conf_contract.value != 0,err::SYSTEM_ERROR, "Invalid conf_table");
-    
-    fiat_conf_t::idx_t conf_tbl(_gstate.conf_contract,_gstate.conf_contract.value);
-    auto itr = conf_tbl.find( _self.value );
-    CHECKC( itr != conf_tbl.end(),err::CONF_NOT_FOUND, "conf table not existed in contract: " + _gstate.conf_contract.to_string());
-    return conf_tbl.get( _self.value );
+
+    auto version = read_conf_version(_gstate.conf_contract, _self);
+    conf_digest_singleton conf_digest_tbl(_self, _self.value);
+    if (!refresh && conf_digest_tbl.exists()) {
+        auto conf_digest = conf_digest_tbl.get();
+        if (conf_digest.version.value_or(0) == version) {
+            _conf_ptr = std::make_unique<conf_t>(conf_digest.conf);
+            return *_conf_ptr;
+        }
+    }
+
+    auto fiat_conf = fiat_conf_t( _self );
+    CHECKC( read_fiat_conf(_gstate.conf_contract, fiat_conf),err::CONF_NOT_FOUND, "conf table not existed in contract: " + _gstate.conf_contract.to_string());
+    _conf_ptr = std::make_unique<conf_t>(fiat_conf);
+    conf_digest_tbl.set( conf_digest_tbl_t( *_conf_ptr, version ), get_self() );
+    return *_conf_ptr;
+}
+
+/**
+ * hot conf pushed by conf contract is used if its version is current,
+ * otherwise read the hot conf of conf contract and save it
+ */
+const fiat_conf_hot_t& otcbook::_hot_conf(bool refresh/* = false*/) {
+    if (_hot_conf_ptr && !refresh) return *_hot_conf_ptr;
+
+    CHECKC(_gstate.conf_contract.value != 0,err::SYSTEM_ERROR, "Invalid conf_table");
+
+    auto version = read_hot_conf_version(_gstate.conf_contract, _self);
+    conf_hot_singleton conf_hot_tbl(_self, _self.value);
+    if (!refresh && conf_hot_tbl.exists()) {
+        auto conf_hot = conf_hot_tbl.get();
+        if (conf_hot.version == version) {
+            _hot_conf_ptr = std::make_unique<hot_conf_t>(conf_hot.conf);
+            return *_hot_conf_ptr;
+        }
+    }
+
+    auto fiat_conf = fiat_conf_t( _self );
+    CHECKC( read_fiat_conf(_gstate.conf_contract, fiat_conf),err::CONF_NOT_FOUND, "conf table not existed in contract: " + _gstate.conf_contract.to_string());
+    _hot_conf_ptr = std::make_unique<hot_conf_t>(fiat_conf);
+    conf_hot_tbl.set( conf_hot_tbl_t( *_hot_conf_ptr, version ), get_self() );
+    return *_hot_conf_ptr;
 }
 
 void otcbook::stakechanged(const name& account, const asset &quantity, const string& memo){
@@ -1009,13 +1609,52 @@ void otcbook::rejectmerch(const name& account, const string& reject_reason, cons
     require_recipient(account);
 }
 
+void otcbook::dealevent(const name& account, const deal_event_t& event){
+    require_auth(get_self());
+    require_recipient(account);
+}
+
+void otcbook::setnotify(const name& account, const uint8_t& flags) {
+    require_auth( account );
+    uint8_t all_flags = (uint8_t)notify_flag_t::DEAL_INFO | (uint8_t)notify_flag_t::DEAL_EVENT | (uint8_t)notify_flag_t::STAKE_CHANGED;
+    CHECKC( (flags & ~all_flags) == 0, err::PARAM_ERROR, "invalid flags: " + to_string(flags) );
+
+    auto pref = notify_pref_t(account);
+    if (flags == default_notify_flags) {
+        _dbc.del( pref );
+        return;
+    }
+    pref.flags = flags;
+    _dbc.set( pref, account );
+}
+
+void otcbook::_notify_deal(const name& account, const uint8_t& action_type, const deal_change_info& deal) {
+    auto pref = notify_pref_t(account);
+    _dbc.get( pref );
+    if (pref.has(notify_flag_t::DEAL_INFO))
+        DEAL_NOTIFY(account, _conf().app_info, action_type, deal);
+    if (pref.has(notify_flag_t::DEAL_EVENT))
+        DEAL_EVENT(account, deal_event_t(action_type, deal));
+}
+
+void otcbook::_notify_stake(const name& account, const asset& quantity, const string& memo) {
+    auto pref = notify_pref_t(account);
+    _dbc.get( pref );
+    if (pref.has(notify_flag_t::STAKE_CHANGED))
+        STAKE_CHANGED(account, quantity, memo);
+}
+
 void otcbook::setdearbiter(const uint64_t& deal_id, const name& new_arbiter) {
     require_auth( _self );
 
-    deal_t::idx_t deals(_self, _self.value);
-    auto deal_itr = deals.find(deal_id);
+    deal_t::idx_t deals(_self, _scope_of(deal_id));
+    auto deal_itr = _find_deal(deals, deal_id);
     CHECKC( deal_itr != deals.end(),err::ORDER_NOT_FOUND , "deal not found: " + to_string(deal_id) );
 
+    if (deal_itr->arbit_status() == (uint8_t)arbit_status_t::ARBITING) {
+        _close_case( deal_itr->arbiter );
+        _open_case( new_arbiter );
+    }
     deals.modify(*deal_itr, _self, [&]( auto& row ) {
         row.arbiter = new_arbiter;
     });
@@ -1032,21 +1671,123 @@ void otcbook::_set_blacklist(const name& account, uint64_t duration_second, cons
     } else {
         blacklist_tbl.erase_by_pk(account.value);
     }
+
+    _purge_blacklist( blacklist_tbl, max_blacklist_lazy_purge );
+}
+
+/**
+ * queue the closed deal for settle::drain, and erase queued deals already drained
+ */
+void otcbook::_queue_settle(const name& settle_contract, const deal_t& deal, const asset& quantity, const asset& fee) {
+    if ( quantity.symbol != CASH_SYMBOL || fee.symbol != CASH_SYMBOL ) return;   // not settled by settle contract
+
+    _purge_settle_queue( settle_contract, max_settle_queue_lazy_purge );
+
+    auto& queue = _dbc.get_tbl<settle_queue_t>(_self.value);
+    _gstate2_changed = true;
+    queue.emplace( _self, [&]( auto& row ) {
+        row.id          = ++_gstate2.settle_queue_id;
+        row.deal_id     = deal.id;
+        row.merchant    = deal.order_maker;
+        row.user        = deal.order_taker;
+        row.quantity    = quantity.amount;
+        row.fee         = fee.amount;
+        row.deal_time   = (deal.closed_at() - deal.created_at).to_seconds();
+    });
+}
+
+uint32_t otcbook::_purge_blacklist(blacklist_t::idx_t& blacklist_tbl, const uint32_t& max_rows) {
+    auto now = time_point_sec(current_time_point());
+    auto expiry_idx = blacklist_tbl.get_index<"expiry"_n>();
+    auto itr = expiry_idx.begin();
+    uint32_t count = 0;
+    for (; count < max_rows && itr != expiry_idx.end() && itr->expired_at <= now; count++) {
+        itr = expiry_idx.erase(itr);
+    }
+    return count;
+}
+
+uint32_t otcbook::_purge_settle_queue(const name& settle_contract, const uint32_t& max_rows) {
+    settle_cursor_t::idx_t cursors(settle_contract, settle_contract.value);
+    auto cursor = cursors.find(_self.value);
+    if (cursor == cursors.end()) return 0;
+
+    auto& queue = _dbc.get_tbl<settle_queue_t>(_self.value);
+    auto itr = queue.begin();
+    uint32_t count = 0;
+    for (; count < max_rows && itr != queue.end() && itr->id < cursor->next_id; count++) {
+        itr = queue.erase(itr);
+    }
+    return count;
+}
+
+void otcbook::purgesettle(const uint32_t& max_rows) {
+    CHECKC( max_rows > 0, err::NOT_POSITIVE, "max_rows must be positive" )
+
+    auto settle_contract = _conf().manager(otc::manager_type::settlement);
+    _purge_settle_queue(settle_contract, max_rows);
+}
+
+void otcbook::purgeblack(const uint32_t& max_rows) {
+    CHECKC( max_rows > 0, err::NOT_POSITIVE, "max_rows must be positive" )
+
+    blacklist_t::idx_t blacklist_tbl(_self, _self.value);
+    _purge_blacklist(blacklist_tbl, max_rows);
+}
+
+void otcbook::migrateblack(const name& start_account, const uint32_t& max_rows) {
+    require_auth( _self );
+    CHECKC( max_rows > 0, err::NOT_POSITIVE, "max_rows must be positive" )
+
+    legacy_blacklist_t::idx_t legacy_tbl(_self, _self.value);
+    blacklist_t::idx_t blacklist_tbl(_self, _self.value);
+    auto expiry_idx = blacklist_tbl.get_index<"expiry"_n>();
+
+    auto itr = legacy_tbl.lower_bound(start_account.value);
+    for (uint32_t count = 0; count < max_rows && itr != legacy_tbl.end(); count++) {
+        auto row = *itr;
+        auto key = (uint128_t)row.expired_at.utc_seconds << 64 | row.account.value;
+        if (expiry_idx.find(key) != expiry_idx.end()) {
+            itr++;
+            continue;
+        }
+        // re-insert the row to add the missing expiry index, expired one is dropped
+        itr = legacy_tbl.erase(itr);
+        if (row.expired_at <= time_point_sec(current_time_point()))
+            continue;
+        blacklist_tbl.emplace( _self, [&]( auto& r ) {
+            r.account       = row.account;
+            r.expired_at    = row.expired_at;
+        });
+    }
+}
+
+bool otcbook::_get_merchant(merchant_t& merchant) {
+    auto itr = _merchants.find(merchant.owner);
+    if (itr != _merchants.end()) {
+        merchant = itr->second;
+        return true;
+    }
+    return _dbc.get(merchant);
+}
+
+void otcbook::_set_merchant(const merchant_t& merchant) {
+    _merchants[merchant.owner] = merchant;
 }
 
 void otcbook::_add_balance(merchant_t& merchant, const asset& quantity, const string & memo){
     merchant.assets[quantity.symbol].balance += quantity.amount;
     merchant.updated_at = current_time_point();
-    _dbc.set( merchant , get_self());
-    if(memo.length() > 0) STAKE_CHANGED(merchant.owner, quantity, memo);
+    _set_merchant(merchant);
+    if(memo.length() > 0) _notify_stake(merchant.owner, quantity, memo);
 }
 
 void otcbook::_sub_balance(merchant_t& merchant, const asset& quantity, const string & memo){
     CHECKC( merchant.assets[quantity.symbol].balance >= quantity.amount,err::QUANTITY_INSUFFICIENT, "merchant stake balance quantity insufficient");
     merchant.assets[quantity.symbol].balance -= quantity.amount;
     merchant.updated_at = current_time_point();
-    _dbc.set( merchant , get_self());
-    if(memo.length() > 0) STAKE_CHANGED(merchant.owner, -quantity, memo);
+    _set_merchant(merchant);
+    if(memo.length() > 0) _notify_stake(merchant.owner, -quantity, memo);
 }
 
 void otcbook::_frozen(merchant_t& merchant, const asset& quantity){
@@ -1054,7 +1795,7 @@ void otcbook::_frozen(merchant_t& merchant, const asset& quantity){
     merchant.assets[quantity.symbol].balance -= quantity.amount;
     merchant.assets[quantity.symbol].frozen += quantity.amount;
     merchant.updated_at = current_time_point();
-    _dbc.set( merchant , get_self());
+    _set_merchant(merchant);
 }
 
 
@@ -1063,7 +1804,7 @@ void otcbook::_unfrozen(merchant_t& merchant, const asset& quantity){
     merchant.assets[quantity.symbol].frozen -= quantity.amount;
     merchant.assets[quantity.symbol].balance += quantity.amount;
     merchant.updated_at = current_time_point();
-    _dbc.set( merchant , get_self());
+    _set_merchant(merchant);
 }
 
 
@@ -1078,14 +1819,13 @@ void otcbook::_merchant_apply(name from, asset quantity, vector<string_view> mem
     CHECKC(email.size() < 64,err::EMAIL_TOO_LARGE, "email size too large: " + to_string(email.size()) );
 
     merchant_t merchant(from);
-    CHECKC(!_dbc.get( merchant ),err::ACCOUNT_EXISING,"merchant is existed");
+    CHECKC(!_get_merchant(merchant),err::ACCOUNT_EXISING,"merchant is existed");
     
     merchant.merchant_name = merchant_name;
     merchant.merchant_detail = merchant_detail;
     merchant.email = email;
     merchant.status = (uint8_t)merchant_status_t::BASIC;
     _add_balance(merchant, quantity, "merchant deposit");
-    _dbc.set(merchant, get_self());
 }
 
 void otcbook::_transfer_open_deal(name from, asset quantity, vector<string_view> memo_params) {
@@ -1102,8 +1842,8 @@ void otcbook::_transfer_process_deal(name from, asset quantity, vector<string_vi
     uint64_t deal_id = to_uint64(memo_params[2], "deal id param error");
     uint8_t action_type = to_uint64(memo_params[3], "action_type id param error");
     deal_t deal = _process(from, account_type, deal_id, action_type);
-    auto stake_coin_type = _conf().coin_as_stake.at(deal.deal_quantity.symbol);
-    auto stake_amount = multiply_decimal64( deal.deal_quantity.amount, get_precision(stake_coin_type), get_precision(deal.deal_quantity.symbol));
+    auto stake_coin_type = _hot_conf().stake_coin(deal.deal_quantity().symbol);
+    auto stake_amount = multiply_decimal64( deal.deal_quantity().amount, get_precision(stake_coin_type), get_precision(deal.deal_quantity().symbol));
     CHECKC( asset(stake_amount, stake_coin_type) == quantity, err::QUANTITY_MISMATCH, "quantity must eqault to deal quantity" )
     TRANSFER( get_first_receiver(), from == deal.order_maker? deal.order_taker : deal.order_maker, 
         quantity, "metabalance deal: " + to_string(deal.id) );
@@ -1113,8 +1853,8 @@ void otcbook::_transfer_close_deal(name from, asset quantity, vector<string_view
     uint8_t account_type = to_uint8(memo_params[1], "account_type id param error");
     uint64_t deal_id = to_uint64(memo_params[2], "deal id param error");
     deal_t deal = _closedeal(from, account_type, deal_id, "auto close by transfer", true);
-    auto stake_coin_type = _conf().coin_as_stake.at(deal.deal_quantity.symbol);
-    auto stake_amount = multiply_decimal64( deal.deal_quantity.amount, get_precision(stake_coin_type), get_precision(deal.deal_quantity.symbol));
+    auto stake_coin_type = _hot_conf().stake_coin(deal.deal_quantity().symbol);
+    auto stake_amount = multiply_decimal64( deal.deal_quantity().amount, get_precision(stake_coin_type), get_precision(deal.deal_quantity().symbol));
     CHECKC( asset(stake_amount, stake_coin_type) == quantity, err::QUANTITY_MISMATCH, "quantity must eqault to deal quantity" )
     TRANSFER( get_first_receiver(), from == deal.order_maker? deal.order_taker : deal.order_maker, 
         quantity, "metabalance deal: " + to_string(deal.id) );
@@ -1137,6 +1877,11 @@ void otcbook::addarbiter(const name& sender, const name& account, const string&
      arbiter.email = email;
     // CHECKC( !_dbc.get(arbiter), err::ACCOUNT_EXISING, "arbiter already exists: " + account.to_string() );
     _dbc.set( arbiter, get_self());
+
+    // also adds load of arbiters added before load tracking
+    auto load = arbiter_load_t(account);
+    if ( !_dbc.get(load) )
+        _dbc.set( load, get_self());
 }
 
 void otcbook::delarbiter(const name& sender, const name& account) {
@@ -1146,31 +1891,45 @@ void otcbook::delarbiter(const name& sender, const name& account) {
     CHECKC( _dbc.get(arbiter), err::ACCOUNT_NOT_FOUND, "arbiter not found: " + account.to_string() );
 
     _dbc.del( arbiter);
+    _dbc.del( arbiter_load_t(account) );
     _gstate.arbiter_count = _gstate.arbiter_count - 1;
 }
 
 void otcbook::setarbitcnt ( const uint64_t count) {
-
     require_auth( _self );
     _gstate.arbiter_count = count;
 }
 
-void otcbook::_rand_arbiter( const uint64_t deal_id, name& arbiter ) {
+name otcbook::_pick_arbiter() {
+    auto& loads = _dbc.get_tbl<arbiter_load_t>( get_self().value );
+    auto load_idx = loads.get_index<"opencase"_n>();
+    auto itr = load_idx.begin();
+    CHECKC( itr != load_idx.end(), err::RECORD_NOT_FOUND, "no arbiter available" );
 
-    uint64_t rand = deal_id % _gstate.arbiter_count;
+    auto arbiter = itr->account;
+    load_idx.modify( itr, same_payer, [&]( auto& row ) {
+        row.open_case_num++;
+    });
+    return arbiter;
+}
 
-    arbiter_t::idx_t arbiter_idx( get_self(), get_self().value);
-    auto itr = arbiter_idx.begin();
-    if (rand > 0) {
-        uint64_t curr_num = 0;
-        for( ; itr != arbiter_idx.end(); itr++){
-            curr_num ++;
-            if ( rand <= curr_num)
-                break;
-        }
-    }
-    
-    arbiter = itr->account;
+void otcbook::_open_case( const name& arbiter ) {
+    auto load = _dbc.find<arbiter_load_t>( arbiter.value );
+    if (!load.exists()) return;
+
+    load.modify( same_payer, [&]( auto& row ) {
+        row.open_case_num++;
+    });
+}
+
+void otcbook::_close_case( const name& arbiter ) {
+    auto load = _dbc.find<arbiter_load_t>( arbiter.value );
+    // arbiter deleted, or case opened before load tracking
+    if (!load.exists() || load->open_case_num == 0) return;
+
+    load.modify( same_payer, [&]( auto& row ) {
+        row.open_case_num--;
+    });
 }
 
 void otcbook::_check_split_plan( const name& token_split_contract, const uint64_t& token_split_plan_id, const name& scope ) {
@@ -1190,6 +1949,7 @@ void otcbook::_update_arbiter_info( const name& account, const asset& quant, con
 
     arbiter.total_quant.amount += quant.amount;
     _dbc.set( arbiter, get_self());
+    _close_case( account );
 }
 
 void otcbook::_require_admin(const name& account) {
@@ -100,7 +100,33 @@ public:
     [[eosio::action]]
     void setconf( const fiat_conf_t& conf );
 
+    /**
+     * add or remove consumer of the conf, consumer receives pubconf action on every change of the conf
+     * @param contract_name contract name of the conf
+     * @param consumer consumer contract, must have pubconf(conf_digest_t) action
+     * @param to_add add if true, otherwise remove
+     * @param hot_conf if true, consumer also receives pubhotconf(fiat_conf_hot_t) on every change of the hot conf,
+     *          it must have pubhotconf action
+     * @note require contract admin auth
+     */
+    [[eosio::action]]
+    void setsubscribe(const name& contract_name, const name& consumer, const bool& to_add, const bool& hot_conf);
+
+    /**
+     * move the fiatconf row of earlier versions to the cold and hot rows, any change of the conf also moves it
+     * @param contract_name contract name of the conf
+     * @note require contract auth
+     */
+    [[eosio::action]]
+    void migrateconf(const name& contract_name);
+
 private:
+    bool _get_conf(fiat_conf_t& fiat_conf, fiat_conf_hot_t& hot);
+    void _set_conf(const fiat_conf_t& fiat_conf);
+    void _set_cold(const fiat_conf_t& fiat_conf);
+    void _publish(const fiat_conf_t& fiat_conf);
+    void _publish_digest(const conf_digest_t& digest);
+    void _publish_hot(const fiat_conf_hot_t& hot);
 
 };
 
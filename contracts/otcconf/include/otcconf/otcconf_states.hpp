@@ -6,6 +6,7 @@
 #include <eosio/system.hpp>
 #include <eosio/time.hpp>
 #include <eosio/name.hpp>
+#include <eosio/crypto.hpp>
 #include <otcconf/wasm_db.hpp>
 
 #include <optional>
@@ -194,27 +195,31 @@ struct [[eosio::table("global"), eosio::contract("otcconf")]] global_t {
 typedef eosio::singleton< "global"_n, global_t > global_singleton;
 
 
+/**
+ * conf of a contract, stored as fiat_conf_cold_t and fiat_conf_hot_t, read the conf by read_fiat_conf()
+ * fiatconf rows of earlier versions are erased once moved to both
+ */
 struct CONTRACT_TBL fiat_conf_t {
 
     name                        contract_name;
     name                        status = conf_status::UN_INITIALIZE;
     AppInfo_t                   app_info;
-    map<name,name>              managers;
+    flat::map<name,name>        managers;
 
     // for book config
-    set<name>                   pay_type;
+    flat::set<name>             pay_type;
     symbol                      fiat_type;
     uint64_t                    fee_pct;
-    map<symbol, name>           stake_assets_contract; //get the contract 
-    map<symbol, symbol>         coin_as_stake;  //get stake asset for a coin
-    symbol_set                  buy_coins_conf;  //crypto coins that OTC merchants can buy in orders
-    symbol_set                  sell_coins_conf; //crypto coins that OTC merchants can sell in orders
+    flat::map<symbol, name>     stake_assets_contract; //get the contract 
+    flat::map<symbol, symbol>   coin_as_stake;  //get stake asset for a coin
+    flat::set<symbol>           buy_coins_conf;  //crypto coins that OTC merchants can buy in orders
+    flat::set<symbol>           sell_coins_conf; //crypto coins that OTC merchants can sell in orders
     uint64_t                    accepted_timeout;
     uint64_t                    payed_timeout;
 
     // for settle config
     vector<settle_level_config> settle_levels;
-    map <symbol_code, uint32_t> farm_scales;
+    flat::map<symbol_code, uint32_t> farm_scales;
     uint64_t                    farm_lease_id = 0;       //aplink.farm lease ID
 
     // for swap config
@@ -236,8 +241,264 @@ struct CONTRACT_TBL fiat_conf_t {
                                 (farm_scales)(farm_lease_id)
                                 (swap_steps) )
 
-    typedef eosio::multi_index < "fiatconf"_n,  fiat_conf_t> idx_t;
+    typedef eosio::multi_index < "fiatconf"_n,  fiat_conf_t> idx_t;   // rows of earlier versions, see fiat_conf_cold_t
+
+};
+
+/**
+ * fields of fiat_conf_t read on every trade, patched by their own setters without rewriting the cold row
+ */
+struct CONTRACT_TBL fiat_conf_hot_t {
+    name                        contract_name;
+    name                        status = conf_status::UN_INITIALIZE;
+    uint64_t                    fee_pct = 0;
+    flat::map<symbol, symbol>   coin_as_stake;
+    uint64_t                    accepted_timeout = 0;
+    uint64_t                    payed_timeout = 0;
+
+    fiat_conf_hot_t() {}
+    fiat_conf_hot_t( const name& cname ):contract_name(cname) { }
+    fiat_conf_hot_t( const fiat_conf_t& conf ):
+        contract_name(conf.contract_name), status(conf.status), fee_pct(conf.fee_pct),
+        coin_as_stake(conf.coin_as_stake),
+        accepted_timeout(conf.accepted_timeout), payed_timeout(conf.payed_timeout) {}
+
+    uint64_t primary_key()const { return contract_name.value ; }
+
+    bool has_stake_coin(const symbol& coin) const { return coin_as_stake.count(coin) != 0; }
+
+    const symbol& stake_coin(const symbol& coin) const {
+        auto itr = coin_as_stake.find(coin);
+        CHECKC( itr != coin_as_stake.end(), err::SYMBOL_MISMATCH, "stake coin not found for: " + coin.code().to_string() )
+        return itr->second;
+    }
+
+    void apply(fiat_conf_t& conf) const {
+        conf.status             = status;
+        conf.fee_pct            = fee_pct;
+        conf.coin_as_stake      = coin_as_stake;
+        conf.accepted_timeout   = accepted_timeout;
+        conf.payed_timeout      = payed_timeout;
+    }
+
+    EOSLIB_SERIALIZE( fiat_conf_hot_t, (contract_name)(status)(fee_pct)(coin_as_stake)
+                                (accepted_timeout)(payed_timeout) )
+
+    typedef eosio::multi_index < "fiatconfhot"_n,  fiat_conf_hot_t> idx_t;
+};
+
+/**
+ * fields of fiat_conf_t other than fiat_conf_hot_t, the conf is the pair of the cold and hot rows
+ * replaces the fiatconf row of earlier versions, which is moved to both rows by the first change of the conf
+ * or by otcconf::migrateconf
+ */
+struct CONTRACT_TBL fiat_conf_cold_t {
+    name                        contract_name;
+    AppInfo_t                   app_info;
+    flat::map<name,name>        managers;
+
+    // for book config
+    flat::set<name>             pay_type;
+    symbol                      fiat_type;
+    flat::map<symbol, name>     stake_assets_contract;
+    flat::set<symbol>           buy_coins_conf;
+    flat::set<symbol>           sell_coins_conf;
+
+    // for settle config
+    vector<settle_level_config> settle_levels;
+    flat::map<symbol_code, uint32_t> farm_scales;
+    uint64_t                    farm_lease_id = 0;
+
+    // for swap config
+    vector<swap_step_config>    swap_steps;
+
+    fiat_conf_cold_t() {}
+    fiat_conf_cold_t( const name& cname ):contract_name(cname) { }
+    fiat_conf_cold_t( const fiat_conf_t& conf ):
+        contract_name(conf.contract_name), app_info(conf.app_info), managers(conf.managers),
+        pay_type(conf.pay_type), fiat_type(conf.fiat_type), stake_assets_contract(conf.stake_assets_contract),
+        buy_coins_conf(conf.buy_coins_conf), sell_coins_conf(conf.sell_coins_conf),
+        settle_levels(conf.settle_levels), farm_scales(conf.farm_scales), farm_lease_id(conf.farm_lease_id),
+        swap_steps(conf.swap_steps) {}
+
+    uint64_t primary_key()const { return contract_name.value ; }
+
+    void apply(fiat_conf_t& conf) const {
+        conf.contract_name          = contract_name;
+        conf.app_info               = app_info;
+        conf.managers               = managers;
+        conf.pay_type               = pay_type;
+        conf.fiat_type              = fiat_type;
+        conf.stake_assets_contract  = stake_assets_contract;
+        conf.buy_coins_conf         = buy_coins_conf;
+        conf.sell_coins_conf        = sell_coins_conf;
+        conf.settle_levels          = settle_levels;
+        conf.farm_scales            = farm_scales;
+        conf.farm_lease_id          = farm_lease_id;
+        conf.swap_steps             = swap_steps;
+    }
+
+    EOSLIB_SERIALIZE( fiat_conf_cold_t, (contract_name)(app_info)(managers)
+                                (pay_type)(fiat_type)
+                                (stake_assets_contract)
+                                (buy_coins_conf)(sell_coins_conf)
+                                (settle_levels)
+                                (farm_scales)(farm_lease_id)
+                                (swap_steps) )
+
+    typedef eosio::multi_index < "fiatconfcold"_n,  fiat_conf_cold_t> idx_t;
+};
+
+/**
+ * read the conf of conf.contract_name from conf contract, the cold and hot rows merged
+ * falls back to the fiatconf row of earlier versions if the conf is not moved yet
+ * @return false if not found
+ */
+inline bool read_fiat_conf(const name& conf_contract, fiat_conf_t& conf) {
+    fiat_conf_hot_t::idx_t hot_tbl(conf_contract, conf_contract.value);
+    auto hot_itr = hot_tbl.find( conf.contract_name.value );
+
+    fiat_conf_cold_t::idx_t cold_tbl(conf_contract, conf_contract.value);
+    auto cold_itr = cold_tbl.find( conf.contract_name.value );
+    if (cold_itr != cold_tbl.end() && hot_itr != hot_tbl.end()) {
+        cold_itr->apply(conf);
+        hot_itr->apply(conf);
+        return true;
+    }
+
+    fiat_conf_t::idx_t conf_tbl(conf_contract, conf_contract.value);
+    auto itr = conf_tbl.find( conf.contract_name.value );
+    if (itr == conf_tbl.end()) return false;
+    conf = *itr;
+    if (hot_itr != hot_tbl.end()) hot_itr->apply(conf);
+    return true;
+}
+
+/**
+ * versions of the conf of contract_name, version of conf_digest_t fields and hot_version of fiat_conf_hot_t
+ * each bumped by every change of its part, fixed size, so consumers can check it without decoding the conf
+ */
+struct CONTRACT_TBL conf_version_t {
+    name                        contract_name;
+    uint64_t                    version = 0;
+    checksum256                 hash;           //sha256 of the packed conf digest
+    uint64_t                    hot_version = 0;
+    checksum256                 hot_hash;       //sha256 of the packed hot row
+
+    conf_version_t() {}
+    conf_version_t( const name& cname ):contract_name(cname) { }
+
+    uint64_t primary_key()const { return contract_name.value ; }
+
+    EOSLIB_SERIALIZE( conf_version_t, (contract_name)(version)(hash)(hot_version)(hot_hash) )
+
+    typedef eosio::multi_index < "confversion"_n,  conf_version_t> idx_t;
+};
+
+/**
+ * read the conf version of contract_name from conf contract
+ * @return 0 if the conf has never changed since versioning
+ */
+inline uint64_t read_conf_version(const name& conf_contract, const name& contract_name) {
+    conf_version_t::idx_t version_tbl(conf_contract, conf_contract.value);
+    auto itr = version_tbl.find( contract_name.value );
+    return itr != version_tbl.end() ? itr->version : 0;
+}
+
+/**
+ * read the hot conf version of contract_name from conf contract
+ * @return 0 if the hot conf has never changed since versioning
+ */
+inline uint64_t read_hot_conf_version(const name& conf_contract, const name& contract_name) {
+    conf_version_t::idx_t version_tbl(conf_contract, conf_contract.value);
+    auto itr = version_tbl.find( contract_name.value );
+    return itr != version_tbl.end() ? itr->hot_version : 0;
+}
+
+/**
+ * config digest of the rarely changed fields of fiat_conf_t, pushed to consumer contracts by pubconf
+ * fields read on every trade are pushed separately as fiat_conf_hot_t by pubhotconf
+ * maps and sets are flatten into vectors sorted by key
+ */
+struct conf_digest_t {
+    name                            contract_name;
+    AppInfo_t                       app_info;
+    vector<pair<name, name>>        managers;
+    vector<name>                    pay_type;
+    symbol                          fiat_type;
+    vector<pair<symbol, name>>      stake_assets_contract;
+    vector<symbol>                  buy_coins_conf;
+    vector<symbol>                  sell_coins_conf;
+    vector<settle_level_config>     settle_levels;
+
+    conf_digest_t() {}
+    conf_digest_t(const fiat_conf_t& conf):
+        contract_name(conf.contract_name), app_info(conf.app_info),
+        managers(conf.managers.begin(), conf.managers.end()),
+        pay_type(conf.pay_type.begin(), conf.pay_type.end()),
+        fiat_type(conf.fiat_type),
+        stake_assets_contract(conf.stake_assets_contract.begin(), conf.stake_assets_contract.end()),
+        buy_coins_conf(conf.buy_coins_conf.begin(), conf.buy_coins_conf.end()),
+        sell_coins_conf(conf.sell_coins_conf.begin(), conf.sell_coins_conf.end()),
+        settle_levels(conf.settle_levels) {}
+
+    uint64_t primary_key()const { return contract_name.value ; }
+
+    bool has_pay_type(const name& type) const { return contains(pay_type, type); }
+    bool can_buy(const symbol& coin) const { return contains(buy_coins_conf, coin); }
+    bool can_sell(const symbol& coin) const { return contains(sell_coins_conf, coin); }
+    bool has_stake_contract(const symbol& stake) const { return find(stake_assets_contract, stake) != nullptr; }
+
+    const name& stake_contract(const symbol& stake) const {
+        auto contract = find(stake_assets_contract, stake);
+        CHECKC( contract != nullptr, err::SYMBOL_MISMATCH, "stake contract not found for: " + stake.code().to_string() )
+        return *contract;
+    }
+
+    const name& manager(const name& type) const {
+        auto account = find(managers, type);
+        CHECKC( account != nullptr, err::CONF_NOT_FOUND, "manager not found: " + type.to_string() )
+        return *account;
+    }
+
+    EOSLIB_SERIALIZE( conf_digest_t, (contract_name)(app_info)(managers)
+                                (pay_type)(fiat_type)
+                                (stake_assets_contract)
+                                (buy_coins_conf)(sell_coins_conf)
+                                (settle_levels) )
+
+private:
+    template<typename K>
+    static bool contains(const vector<K>& items, const K& key) {
+        return std::binary_search(items.begin(), items.end(), key);
+    }
+
+    template<typename K, typename V>
+    static const V* find(const vector<pair<K, V>>& items, const K& key) {
+        auto itr = std::lower_bound(items.begin(), items.end(), key,
+            [](const pair<K, V>& item, const K& k) { return item.first < k; });
+        return (itr != items.end() && itr->first == key) ? &itr->second : nullptr;
+    }
+};
+
+/**
+ * consumer contracts of the conf of contract_name
+ * every change of the conf will be pushed to consumers by pubconf action
+ * and every change of the hot conf to hot_consumers by pubhotconf action
+ */
+struct CONTRACT_TBL conf_subscriber_t {
+    name                        contract_name;
+    set<name>                   consumers;
+    set<name>                   hot_consumers;
+
+    conf_subscriber_t() {}
+    conf_subscriber_t( const name& cname ):contract_name(cname) { }
+
+    uint64_t primary_key()const { return contract_name.value ; }
+
+    EOSLIB_SERIALIZE( conf_subscriber_t, (contract_name)(consumers)(hot_consumers) )
 
+    typedef eosio::multi_index < "subscribers"_n,  conf_subscriber_t> idx_t;
 };
 
 
@@ -99,6 +99,7 @@ enum class err: uint32_t {
    TIME_NOT_EXPIRED                     = 10230,    // 交易未到期  
    TIME_NOT_REACHED                     = 10231,    // 未达操作时间
    TIME_TOO_LARGE                       = 10232,    // 时间过长
+   OPEN_ORDERS_EXCEEDED                 = 10233,    // 挂单数超限
 
    SYSTEM_ERROR                         = 20000     // 系统错误
 };
@@ -7,6 +7,12 @@ using namespace eosio;
 using namespace std;
 using std::string;
 
+#define PUB_CONF(consumer, digest, version) \
+    {	action( permission_level{ _self, "active"_n }, consumer, "pubconf"_n, std::make_tuple( digest, version ) ).send(); }
+
+#define PUB_HOT_CONF(consumer, hot, version) \
+    {	action( permission_level{ _self, "active"_n }, consumer, "pubhotconf"_n, std::make_tuple( hot, version ) ).send(); }
+
 namespace otc {
 
 using namespace std;
@@ -28,7 +34,8 @@ void otcconf::init(const name& fiat_contract,
     CHECKC( is_account(settle_contract), err::ACCOUNT_INVALID,"settle_contract name invalid: " + settle_contract.to_string());
 
     auto fiat_conf = fiat_conf_t( fiat_contract );
-    CHECKC( !_db.get(fiat_conf),err::RECORD_EXISTING, "conf existing : " + fiat_contract.to_string())
+    auto hot = fiat_conf_hot_t( fiat_contract );
+    CHECKC( !_get_conf(fiat_conf, hot),err::RECORD_EXISTING, "conf existing : " + fiat_contract.to_string())
 
     fiat_conf.app_info = {
         "meta.balance"_n,
@@ -107,12 +114,14 @@ void otcconf::init(const name& fiat_contract,
     fiat_conf.swap_steps = {
         {0, 1500}, {2000000000, 2500}, {10000000000, 3500}, {25000000000, 5000}};
      
-    _db.set(_self.value,fiat_conf,false);
+    _set_conf(fiat_conf);
+    _publish(fiat_conf);
 }
 
 void otcconf::setmanager(const name& type, const name& account,const name& contract_name){
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
     CHECKC( type == manager_type::admin
             || type == manager_type::feetaker
@@ -128,13 +137,15 @@ void otcconf::setmanager(const name& type, const name& account,const name& contr
     // CHECKC(is_account(account), err::ACCOUNT_INVALID, "invalid account: " + account.to_string());
     fiat_conf.managers[type] = account;
     
-    _db.set(fiat_conf);
+    _set_cold(fiat_conf);
+    _publish_digest(conf_digest_t( fiat_conf ));
 }
 
 void otcconf::addcoin(const bool& is_buy, const symbol& coin, const symbol& stake_coin,const name& contract_name){
 
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
     // require_auth(_gstate.managers.at(manager_type::admin));
@@ -148,12 +159,17 @@ void otcconf::addcoin(const bool& is_buy, const symbol& coin, const symbol& stak
         fiat_conf.sell_coins_conf.insert(coin);
     }
     fiat_conf.coin_as_stake[coin] = stake_coin;
-    _db.set(fiat_conf);
+    hot.coin_as_stake[coin] = stake_coin;
+    _set_cold(fiat_conf);
+    _db.set(hot, _self);
+    _publish_digest(conf_digest_t( fiat_conf ));
+    _publish_hot(hot);
 }
 
 void otcconf::deletecoin(const bool& is_buy, const symbol& coin,const name& contract_name){
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_EXISTING, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_EXISTING, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
     if(is_buy){
@@ -164,63 +180,74 @@ void otcconf::deletecoin(const bool& is_buy, const symbol& coin,const name& cont
         CHECKC( fiat_conf.sell_coins_conf.count(coin), err::RECORD_NOT_FOUND, "coin not in sell coin list" ) 
         fiat_conf.sell_coins_conf.erase(coin);
     }
-    _db.set(fiat_conf);
+    _set_cold(fiat_conf);
+    _publish_digest(conf_digest_t( fiat_conf ));
 }
 
 void otcconf::setfeepct(const uint64_t& feepct,const name& contract_name){
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
     // require_auth(_gstate.managers.at(manager_type::admin));
     CHECKC(feepct >= 0 && feepct <= 10000, err::NOT_POSITIVE, "unsupport negtive fee");
-    fiat_conf.fee_pct = feepct;
-    _db.set(fiat_conf);
+    hot.fee_pct = feepct;
+    _db.set(hot, _self);
+    _publish_hot(hot);
 }
 
 void otcconf::setsettlelv(const vector<settle_level_config>& configs,const name& contract_name){
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
     fiat_conf.settle_levels = configs;
-    _db.set(fiat_conf);
+    _set_cold(fiat_conf);
+    _publish_digest(conf_digest_t( fiat_conf ));
 }
 
 void otcconf::setswapstep(const vector<swap_step_config> rates,const name& contract_name)
 {
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
     fiat_conf.swap_steps = rates;
-    _db.set(fiat_conf);
+    _set_cold(fiat_conf);   // not in conf digest, nothing to publish
 }
 
 void otcconf::setfarm(const name& farmname, const uint64_t& farm_lease_id, const symbol_code& symcode, const uint32_t& farm_scale,const name& contract_name){
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
     fiat_conf.managers[manager_type::aplinkfarm] = farmname;
     fiat_conf.farm_lease_id = farm_lease_id;
     CHECKC(farm_scale >= 0, err::NOT_POSITIVE, "farm scale value invalid");
     fiat_conf.farm_scales[symcode] = farm_scale;
-    _db.set(fiat_conf);
+    _set_cold(fiat_conf);
+    _publish_digest(conf_digest_t( fiat_conf ));
 }
 
 void otcconf::setappname(const name& otc_name,const name& contract_name) {
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
     fiat_conf.app_info.app_name = otc_name;
-    _db.set(fiat_conf);
+    _set_cold(fiat_conf);
+    _publish_digest(conf_digest_t( fiat_conf ));
 }
 
 void otcconf::setstatus(const name& status,const name& contract_name){
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
     CHECKC( status == conf_status::UN_INITIALIZE
@@ -228,18 +255,21 @@ void otcconf::setstatus(const name& status,const name& contract_name){
             || status == conf_status::RUNNING
             || status == conf_status::MAINTAINING , err::PARAM_ERROR, "status type error: " + status.to_string())
 
-    fiat_conf.status = status;
-    _db.set(fiat_conf);
+    hot.status = status;
+    _db.set(hot, _self);
+    _publish_hot(hot);
 }
 
 void otcconf::settimeout(const uint64_t& accepted_timeout, const uint64_t& payed_timeout,const name& contract_name) {
     auto fiat_conf = fiat_conf_t( contract_name );
-    CHECKC( _db.get(fiat_conf),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
     CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
 
-    fiat_conf.accepted_timeout = accepted_timeout;
-    fiat_conf.payed_timeout = payed_timeout;
-    _db.set(fiat_conf);
+    hot.accepted_timeout = accepted_timeout;
+    hot.payed_timeout = payed_timeout;
+    _db.set(hot, _self);
+    _publish_hot(hot);
 }
 
 void otcconf::setconf( const fiat_conf_t& conf ) {
@@ -251,11 +281,124 @@ void otcconf::setconf( const fiat_conf_t& conf ) {
             || conf.status == conf_status::MAINTAINING , err::PARAM_ERROR, "status type error: " + conf.status.to_string())
     CHECKC( conf.fee_pct >= 0, err::NOT_POSITIVE, "unsupport negtive fee");
 
-    auto fiat_conf = fiat_conf_t( conf.contract_name );
-    if ( !_db.get(fiat_conf) ){
-        _db.set(_self.value,conf,false);
+    _set_conf(conf);
+    _publish(conf);
+}
+
+void otcconf::migrateconf(const name& contract_name) {
+    require_auth( _self );
+
+    auto fiat_conf = fiat_conf_t( contract_name );
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+}
+
+void otcconf::setsubscribe(const name& contract_name, const name& consumer, const bool& to_add, const bool& hot_conf) {
+    auto fiat_conf = fiat_conf_t( contract_name );
+    auto hot = fiat_conf_hot_t( contract_name );
+    CHECKC( _get_conf(fiat_conf, hot),err::RECORD_NOT_FOUND, "conf not existing : " + contract_name.to_string())
+    CHECKC( has_auth(_self) || has_auth(fiat_conf.managers.at(manager_type::admin)), err::NO_AUTH, "Missing required authority of admin or managers" )
+
+    auto subscriber = conf_subscriber_t( contract_name );
+    _db.get(subscriber);
+    if (to_add) {
+        CHECKC( is_account(consumer), err::ACCOUNT_INVALID, "consumer invalid: " + consumer.to_string())
+        CHECKC( subscriber.consumers.insert(consumer).second, err::RECORD_EXISTING, "consumer existing: " + consumer.to_string())
+        PUB_CONF(consumer, conf_digest_t(fiat_conf), read_conf_version(_self, contract_name));
+        if (hot_conf) {
+            subscriber.hot_consumers.insert(consumer);
+            PUB_HOT_CONF(consumer, hot, read_hot_conf_version(_self, contract_name));
+        }
     } else {
-        _db.set(conf);
+        CHECKC( subscriber.consumers.erase(consumer), err::RECORD_NOT_FOUND, "consumer not existing: " + consumer.to_string())
+        subscriber.hot_consumers.erase(consumer);
+    }
+
+    if (subscriber.consumers.empty())
+        _db.del(subscriber);
+    else
+        _db.set(subscriber, _self);
+}
+
+/**
+ * get the conf merged from its cold and hot rows, a fiatconf row of earlier versions is moved to both first
+ */
+bool otcconf::_get_conf(fiat_conf_t& fiat_conf, fiat_conf_hot_t& hot) {
+    auto cold = fiat_conf_cold_t( fiat_conf.contract_name );
+    if ( _db.get(cold) && _db.get(hot) ) {
+        cold.apply(fiat_conf);
+        hot.apply(fiat_conf);
+        return true;
+    }
+
+    if ( !_db.get(fiat_conf) ) return false;
+    // the hot row is newer than hot fields of fiatconf if it exists
+    if ( _db.get(hot) )
+        hot.apply(fiat_conf);
+    else
+        hot = fiat_conf_hot_t(fiat_conf);
+    _set_conf(fiat_conf);
+    return true;
+}
+
+/**
+ * write both rows of the conf, and erase the fiatconf row of earlier versions
+ */
+void otcconf::_set_conf(const fiat_conf_t& fiat_conf) {
+    _db.set(fiat_conf_cold_t(fiat_conf), _self);
+    _db.set(fiat_conf_hot_t(fiat_conf), _self);
+    _db.del(fiat_conf_t(fiat_conf.contract_name));
+}
+
+/**
+ * write the cold row of the conf, the hot row is left untouched
+ */
+void otcconf::_set_cold(const fiat_conf_t& fiat_conf) {
+    _db.set(fiat_conf_cold_t(fiat_conf), _self);
+}
+
+template<typename T>
+static checksum256 hash_of(const T& obj) {
+    auto packed = pack(obj);
+    return sha256(packed.data(), packed.size());
+}
+
+/**
+ * bump the versions of the conf and push the conf digest and hot conf to consumers
+ * setters of one part publish that part alone by _publish_digest() or _publish_hot()
+ */
+void otcconf::_publish(const fiat_conf_t& fiat_conf) {
+    _publish_digest(conf_digest_t( fiat_conf ));
+    _publish_hot(fiat_conf_hot_t( fiat_conf ));
+}
+
+void otcconf::_publish_digest(const conf_digest_t& digest) {
+    auto conf_version = conf_version_t( digest.contract_name );
+    _db.get(conf_version);
+    conf_version.version++;
+    conf_version.hash = hash_of(digest);
+    _db.set(conf_version, _self);
+
+    auto subscriber = conf_subscriber_t( digest.contract_name );
+    if ( !_db.get(subscriber) ) return;
+
+    for (const auto& consumer : subscriber.consumers) {
+        PUB_CONF(consumer, digest, conf_version.version);
+    }
+}
+
+void otcconf::_publish_hot(const fiat_conf_hot_t& hot) {
+    auto conf_version = conf_version_t( hot.contract_name );
+    _db.get(conf_version);
+    conf_version.hot_version++;
+    conf_version.hot_hash = hash_of(hot);
+    _db.set(conf_version, _self);
+
+    auto subscriber = conf_subscriber_t( hot.contract_name );
+    if ( !_db.get(subscriber) ) return;
+
+    for (const auto& consumer : subscriber.hot_consumers) {
+        PUB_HOT_CONF(consumer, hot, conf_version.hot_version);
     }
 }
 
@@ -34,8 +34,7 @@ static constexpr uint32_t percent_boost = 10000;
 
 struct [[eosio::table("global"), eosio::contract("otcfeesplit")]] global_t {
     name admin = "armoniaadmin"_n;
-
-    map<name,uint32_t> split_ratios = { 
+    flat::map<name, uint32_t> split_ratios = { 
         { "amax.daodev"_n,    2000 },
         { "meta.settle"_n,    4000 },
         { "meta.swap"_n,      4000 }
@@ -47,4 +46,20 @@ struct [[eosio::table("global"), eosio::contract("otcfeesplit")]] global_t {
 };
 typedef eosio::singleton< "global"_n, global_t > global_singleton;
 
+/**
+ * fee credited to beneficiary and not claimed yet, scope: beneficiary
+ */
+struct CONTRACT_TBL credit_t {
+    asset balance;              // PK: symbol code
+
+    credit_t() {}
+    credit_t(const symbol& sym): balance(0, sym) {}
+
+    uint64_t primary_key() const { return balance.symbol.code().raw(); }
+
+    typedef eosio::multi_index<"credits"_n, credit_t> idx_t;
+
+    EOSLIB_SERIALIZE( credit_t, (balance) )
+};
+
 } // OTC
\ No newline at end of file
@@ -57,6 +57,14 @@ public:
      */
     ACTION init(const name& admin);
     ACTION setratios(const map<name, uint32_t>& ratios, const bool& to_add);
+    /**
+     * claim fees credited to beneficiary
+     * @param beneficiary beneficiary in split ratios
+     * @param sym symbol of fees to claim
+     * @note require beneficiary auth
+     */
+    ACTION claim(const name& beneficiary, const symbol& sym);
+
     /**
      * ontransfer, trigger by recipient of transfer()
      */
@@ -3,6 +3,13 @@
 #include <eosio/eosio.hpp>
 #include <eosio/asset.hpp>
 
+#include <algorithm>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
 namespace wasm { namespace db {
 
 using namespace eosio;
@@ -39,31 +46,106 @@ enum return_t{
     MODIFIED,
     APPENDED,
 };
+
+/**
+ * handle of a row in the table cached by dbc
+ * reads and writes through the handle reuse the cached row, no more lookup needed
+ */
+template<typename RecordType>
+class row_handle {
+public:
+    typedef typename RecordType::idx_t idx_t;
+
+    row_handle(idx_t& idx, typename idx_t::const_iterator itr): idx(&idx), itr(itr) {}
+
+    bool exists() const { return itr != idx->end(); }
+
+    const RecordType& operator*() const { return *itr; }
+    const RecordType* operator->() const { return &(*itr); }
+
+    template<typename Lambda>
+    void modify(const name& payer, Lambda&& setter) {
+        idx->modify( itr, payer, std::forward<Lambda>(setter) );
+    }
+
+    template<typename Lambda>
+    void emplace(const name& payer, Lambda&& setter) {
+        itr = idx->emplace( payer, std::forward<Lambda>(setter) );
+    }
+
+    void erase() {
+        idx->erase( itr );
+        itr = idx->end();
+    }
+
+private:
+    idx_t* idx;
+    typename idx_t::const_iterator itr;
+};
+
+/**
+ * db accessor of contract tables
+ * only one table object is created for each (table, scope) in an action, all reads and writes go through it,
+ * so a row read once is cached for later reads and writes of the same action.
+ * NOTE: a table accessed by dbc should not be modified by another table object in the same action,
+ *       otherwise the row cached by dbc is stale.
+ */
 class dbc {
 private:
     name code;   //contract owner
 
+    template<typename TableType>
+    struct table_type { static constexpr char id = 0; };    // address of id is unique for each table type
+
+    struct table_slot {
+        const char*             type;
+        uint64_t                scope;
+        std::shared_ptr<void>   idx;
+    };
+    std::vector<table_slot> tables;
+
 public:   
     dbc(const name& code): code(code) {}
 
+    /**
+     * get the table object of scope cached in this action
+     */
     template<typename RecordType>
-    bool get(RecordType& record) {
-        auto scope = code.value;
+    typename RecordType::idx_t& get_tbl(const uint64_t& scope) {
+        typedef typename RecordType::idx_t idx_t;
+        for (const auto& slot : tables) {
+            if (slot.type == &table_type<idx_t>::id && slot.scope == scope)
+                return *static_cast<idx_t*>(slot.idx.get());
+        }
+        auto idx = std::make_shared<idx_t>(code, scope);
+        tables.push_back({ &table_type<idx_t>::id, scope, idx });
+        return *idx;
+    }
 
-        typename RecordType::idx_t idx(code, scope);
-        if (idx.find(record.primary_key()) == idx.end())
-            return false;
+    template<typename RecordType>
+    row_handle<RecordType> find(const uint64_t& pk) {
+        return find<RecordType>(code.value, pk);
+    }
 
-        record = idx.get(record.primary_key());
-        return true;
+    template<typename RecordType>
+    row_handle<RecordType> find(const uint64_t& scope, const uint64_t& pk) {
+        auto& idx = get_tbl<RecordType>(scope);
+        return row_handle<RecordType>(idx, idx.find(pk));
+    }
+
+    template<typename RecordType>
+    bool get(RecordType& record) {
+        return get(code.value, record);
     }
+
     template<typename RecordType>
     bool get(const uint64_t& scope, RecordType& record) {
-        typename RecordType::idx_t idx(code, scope);
-        if (idx.find(record.primary_key()) == idx.end())
+        auto& idx = get_tbl<RecordType>(scope);
+        auto itr = idx.find(record.primary_key());
+        if (itr == idx.end())
             return false;
 
-        record = idx.get(record.primary_key());
+        record = *itr;
         return true;
     }
   
@@ -78,9 +160,7 @@ public:
 
     template<typename RecordType>
     return_t set(const RecordType& record, const name& payer) {
-        auto scope = code.value;
-
-        typename RecordType::idx_t idx(code, scope);
+        auto& idx = get_tbl<RecordType>(code.value);
         auto itr = idx.find( record.primary_key() );
         if ( itr != idx.end()) {
             idx.modify( itr, same_payer, [&]( auto& item ) {
@@ -98,9 +178,7 @@ public:
 
     template<typename RecordType>
     return_t set(const RecordType& record) {
-        auto scope = code.value;
-
-        typename RecordType::idx_t idx(code, scope);
+        auto& idx = get_tbl<RecordType>(code.value);
         auto itr = idx.find( record.primary_key() );
         check( itr != idx.end(), "record not found" );
 
@@ -112,7 +190,7 @@ public:
 
     template<typename RecordType>
     return_t set(const uint64_t& scope, const RecordType& record, const bool& isModify = true) {
-        typename RecordType::idx_t idx(code, scope);
+        auto& idx = get_tbl<RecordType>(scope);
         
         if (isModify) {
             auto itr = idx.find( record.primary_key() );
@@ -131,18 +209,12 @@ public:
 
     template<typename RecordType>
     void del(const RecordType& record) {
-        auto scope = code.value;
-
-        typename RecordType::idx_t idx(code, scope);
-        auto itr = idx.find(record.primary_key());
-        if ( itr != idx.end() ) {
-            idx.erase(itr);
-        }
+        del_scope(code.value, record);
     }
 
     template<typename RecordType>
     void del_scope(const uint64_t& scope, const RecordType& record) {
-        typename RecordType::idx_t idx(code, scope);
+        auto& idx = get_tbl<RecordType>(scope);
         auto itr = idx.find(record.primary_key());
         if ( itr != idx.end() ) {
             idx.erase(itr);
@@ -150,4 +222,183 @@ public:
     }
 };
 
-}}//db//wasm
\ No newline at end of file
+}}//db//wasm
+
+namespace wasm { namespace flat {
+
+/**
+ * map kept in a vector sorted by key, decoded with one allocation instead of one node per entry
+ * serialized the same as std::map, and named map so that abigen emits the same abi type
+ */
+template<typename K, typename V>
+class map {
+public:
+    typedef std::pair<K, V>                                     value_type;
+    typedef typename std::vector<value_type>::iterator          iterator;
+    typedef typename std::vector<value_type>::const_iterator    const_iterator;
+
+    map() {}
+    map(std::initializer_list<value_type> list): items(list) { normalize(); }
+    template<typename InputIt>
+    map(InputIt first, InputIt last): items(first, last) { normalize(); }
+    map(const std::map<K, V>& m): items(m.begin(), m.end()) {}
+
+    iterator begin() { return items.begin(); }
+    iterator end() { return items.end(); }
+    const_iterator begin() const { return items.begin(); }
+    const_iterator end() const { return items.end(); }
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    void clear() { items.clear(); }
+
+    iterator lower_bound(const K& key) {
+        return std::lower_bound(items.begin(), items.end(), key, key_less);
+    }
+    const_iterator lower_bound(const K& key) const {
+        return std::lower_bound(items.begin(), items.end(), key, key_less);
+    }
+    iterator find(const K& key) {
+        auto itr = lower_bound(key);
+        return (itr != items.end() && itr->first == key) ? itr : items.end();
+    }
+    const_iterator find(const K& key) const {
+        auto itr = lower_bound(key);
+        return (itr != items.end() && itr->first == key) ? itr : items.end();
+    }
+    size_t count(const K& key) const { return find(key) != items.end() ? 1 : 0; }
+
+    V& at(const K& key) {
+        auto itr = find(key);
+        eosio::check( itr != items.end(), "key not found in map" );
+        return itr->second;
+    }
+    const V& at(const K& key) const {
+        auto itr = find(key);
+        eosio::check( itr != items.end(), "key not found in map" );
+        return itr->second;
+    }
+    V& operator[](const K& key) {
+        auto itr = lower_bound(key);
+        if (itr == items.end() || itr->first != key)
+            itr = items.insert(itr, value_type(key, V()));
+        return itr->second;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& item) {
+        auto itr = lower_bound(item.first);
+        if (itr != items.end() && itr->first == item.first) return { itr, false };
+        return { items.insert(itr, item), true };
+    }
+    iterator erase(const_iterator pos) { return items.erase(pos); }
+    size_t erase(const K& key) {
+        auto itr = find(key);
+        if (itr == items.end()) return 0;
+        items.erase(itr);
+        return 1;
+    }
+
+    template<typename DataStream>
+    friend DataStream& operator<<(DataStream& ds, const map& m) {
+        ds << eosio::unsigned_int(m.items.size());
+        for (const auto& item : m.items) ds << item.first << item.second;
+        return ds;
+    }
+
+    template<typename DataStream>
+    friend DataStream& operator>>(DataStream& ds, map& m) {
+        eosio::unsigned_int size;
+        ds >> size;
+        m.items.resize(size.value);
+        for (auto& item : m.items) ds >> item.first >> item.second;
+        m.normalize();
+        return ds;
+    }
+
+private:
+    std::vector<value_type> items;
+
+    static bool key_less(const value_type& item, const K& key) { return item.first < key; }
+
+    // sort by key and keep the first of duplicated keys, as std::map does; rows written from std::map are sorted already
+    void normalize() {
+        if (std::adjacent_find(items.begin(), items.end(),
+                [](const value_type& a, const value_type& b) { return !(a.first < b.first); }) == items.end())
+            return;
+        std::stable_sort(items.begin(), items.end(),
+            [](const value_type& a, const value_type& b) { return a.first < b.first; });
+        items.erase(std::unique(items.begin(), items.end(),
+            [](const value_type& a, const value_type& b) { return a.first == b.first; }), items.end());
+    }
+};
+
+/**
+ * set kept in a sorted vector, decoded with one allocation instead of one node per entry
+ * serialized the same as std::set, and named set so that abigen emits the same abi type
+ */
+template<typename K>
+class set {
+public:
+    typedef K                                               value_type;
+    typedef typename std::vector<K>::const_iterator         iterator;
+    typedef typename std::vector<K>::const_iterator         const_iterator;
+
+    set() {}
+    set(std::initializer_list<K> list): items(list) { normalize(); }
+    template<typename InputIt>
+    set(InputIt first, InputIt last): items(first, last) { normalize(); }
+    set(const std::set<K>& s): items(s.begin(), s.end()) {}
+
+    const_iterator begin() const { return items.begin(); }
+    const_iterator end() const { return items.end(); }
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    void clear() { items.clear(); }
+
+    const_iterator find(const K& key) const {
+        auto itr = std::lower_bound(items.begin(), items.end(), key);
+        return (itr != items.end() && *itr == key) ? itr : items.end();
+    }
+    size_t count(const K& key) const { return std::binary_search(items.begin(), items.end(), key) ? 1 : 0; }
+
+    std::pair<const_iterator, bool> insert(const K& key) {
+        auto itr = std::lower_bound(items.begin(), items.end(), key);
+        if (itr != items.end() && *itr == key) return { itr, false };
+        return { items.insert(itr, key), true };
+    }
+    size_t erase(const K& key) {
+        auto itr = find(key);
+        if (itr == items.end()) return 0;
+        items.erase(itr);
+        return 1;
+    }
+
+    template<typename DataStream>
+    friend DataStream& operator<<(DataStream& ds, const set& s) {
+        ds << eosio::unsigned_int(s.items.size());
+        for (const auto& item : s.items) ds << item;
+        return ds;
+    }
+
+    template<typename DataStream>
+    friend DataStream& operator>>(DataStream& ds, set& s) {
+        eosio::unsigned_int size;
+        ds >> size;
+        s.items.resize(size.value);
+        for (auto& item : s.items) ds >> item;
+        s.normalize();
+        return ds;
+    }
+
+private:
+    std::vector<K> items;
+
+    void normalize() {
+        if (std::adjacent_find(items.begin(), items.end(),
+                [](const K& a, const K& b) { return !(a < b); }) == items.end())
+            return;
+        std::sort(items.begin(), items.end());
+        items.erase(std::unique(items.begin(), items.end()), items.end());
+    }
+};
+
+}}//flat//wasm
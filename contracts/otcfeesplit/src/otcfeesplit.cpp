@@ -55,16 +55,27 @@ void otcfeesplit::ontransfer(const name& from, const name& to, const asset& quan
         
     CHECKC( quantity.amount > 0, err::PARAM_ERROR, "negative amount" )
 
-    auto precision              = get_precision(quantity.symbol);
-    auto quant                  = quantity;
-
+    // credit beneficiaries only, fees are paid out by claim()
     for ( const auto &ratio : _gstate.split_ratios ) {
-        auto to                 = ratio.first;
-        quant.amount            = wasm::safemath::mul( wasm::safemath::div(ratio.second, percent_boost, precision),
-                                    quantity.amount, precision);
+        auto amount             = (int64_t)((int128_t)quantity.amount * ratio.second / percent_boost);
+        if (amount == 0) continue;
 
-        TRANSFER( MIRROR_BANK, to, quant, "feesplit" )
+        auto credit             = credit_t(quantity.symbol);
+        auto found              = _db.get( ratio.first.value, credit );
+        credit.balance.amount   += amount;
+        _db.set( ratio.first.value, credit, found );
     }
 }
 
+void otcfeesplit::claim(const name& beneficiary, const symbol& sym) {
+    require_auth( beneficiary );
+
+    auto credit = credit_t(sym);
+    CHECKC( _db.get( beneficiary.value, credit ), err::RECORD_NOT_FOUND, "no credit of " + sym.code().to_string() )
+    CHECKC( credit.balance.amount > 0, err::NOT_POSITIVE, "no credit to claim" )
+
+    _db.del_scope( beneficiary.value, credit );
+    TRANSFER( MIRROR_BANK, beneficiary, credit.balance, "feesplit" )
+}
+
 }  //end of namespace::otc
@@ -30,7 +30,12 @@ private:
     std::unique_ptr<conf_table_t> _conf_tbl_ptr;
     std::unique_ptr<conf_t> _conf_ptr;
 
-    const fiat_conf_t _conf(const name& fait_contract ,bool refresh = false);
+    const conf_digest_t _conf(const name& fait_contract ,bool refresh = false);
+    settle_conf_t _settle_conf(const name& fait_contract);
+
+    template<typename Lambda>
+    void _update_settle(const name& account, Lambda&& updater);
+    void _add_child_deal(const settle_conf_t& conf, const name& creator, const uint64_t& quantity);
 
 public:
     using contract::contract;
@@ -46,6 +51,15 @@ public:
     [[eosio::action]]
     void setconf(const name &conf_contract);
 
+    /**
+     * receive the conf digest published by conf contract
+     * @param conf conf digest of a fiat contract
+     * @param version conf version of the digest
+     * @note require conf contract auth
+     */
+    [[eosio::action]]
+    void pubconf(const conf_digest_t& conf, const uint64_t& version);
+
     [[eosio::action]]
     void setlevel(const name& fait_contract,const name& user, uint8_t level);
 
@@ -59,6 +73,16 @@ public:
                 const time_point_sec& start_at, 
                 const time_point_sec& end_at);
 
+    /**
+     * settle closed deals queued by otcbook in async settle mode, oldest first
+     * deals of the same account are aggregated into one write
+     * @param fait_contract fiat contract whose otcbook queue is drained
+     * @param max_rows max queued deals to settle
+     * @note anyone can call
+     */
+    [[eosio::action]]
+    void drain(const name& fait_contract, const uint32_t& max_rows);
+
     /**
      * @brief claim rewards
      * 
@@ -5,7 +5,9 @@
 #include <eosio/singleton.hpp>
 #include <eosio/system.hpp>
 #include <eosio/time.hpp>
+#include <eosio/binary_extension.hpp>
 #include <otcconf/wasm_db.hpp>
+#include <otcconf/otcconf_states.hpp>
 
 using namespace eosio;
 using namespace std;
@@ -37,6 +39,51 @@ struct SETTLE_TBL_NAME("global") gsettle_t {
 };
 typedef eosio::singleton< "global"_n, gsettle_t > gsettle_singleton;
 
+/**
+ * conf digests pushed by conf contract, one row for each fiat contract
+ * a digest is reloaded from conf contract once version mismatches the conf version there
+ */
+struct SETTLE_TBL_NAME("confdigests") conf_digest_tbl_t {
+    otc::conf_digest_t conf;
+    binary_extension<uint64_t> version;     //conf version of the digest
+
+    conf_digest_tbl_t() {}
+    conf_digest_tbl_t(const otc::conf_digest_t& c, const uint64_t& v): conf(c) { version.emplace(v); }
+    conf_digest_tbl_t(const name& fait_contract) { conf.contract_name = fait_contract; }
+
+    uint64_t primary_key() const { return conf.contract_name.value; }
+
+    typedef eosio::multi_index <"confdigests"_n, conf_digest_tbl_t> idx_t;
+
+    EOSLIB_SERIALIZE( conf_digest_tbl_t, (conf)(version) )
+};
+
+/**
+ * the part of conf digest needed by deal settlement, one row for each fiat contract
+ */
+struct SETTLE_TBL_NAME("settleconfs") settle_conf_t {
+    name                contract_name;
+    name                otcbook;            //the only caller of deal
+    vector<uint64_t>    level_limits;       //sum_limit of each settle level
+    uint64_t            version = 0;        //conf version it is digested from
+
+    settle_conf_t() {}
+    settle_conf_t(const name& fait_contract): contract_name(fait_contract) {}
+    settle_conf_t(const otc::conf_digest_t& conf, const uint64_t& v): contract_name(conf.contract_name), version(v) {
+        for (const auto& manager : conf.managers) {
+            if (manager.first == otc::manager_type::otcbook) otcbook = manager.second;
+        }
+        level_limits.reserve(conf.settle_levels.size());
+        for (const auto& level : conf.settle_levels) level_limits.push_back(level.sum_limit);
+    }
+
+    uint64_t primary_key() const { return contract_name.value; }
+
+    typedef eosio::multi_index <"settleconfs"_n, settle_conf_t> idx_t;
+
+    EOSLIB_SERIALIZE( settle_conf_t, (contract_name)(otcbook)(level_limits)(version) )
+};
+
 struct SETTLE_TBL settle_t {
     name        account;
     uint8_t     level = 0;
@@ -46,6 +93,7 @@ struct SETTLE_TBL settle_t {
     uint32_t    sum_arbit_count = 0;
     uint32_t    sum_deal_time = 0;
     uint64_t    sum_child_deal = 0;
+    binary_extension<name> creator;         //creator of account, cached at the first deal
     
     settle_t() {}
     settle_t(const name& paccount): account(paccount) {}
@@ -57,8 +105,48 @@ struct SETTLE_TBL settle_t {
     typedef wasm::db::multi_index <"settles"_n, settle_t> idx_t;
 
     EOSLIB_SERIALIZE( settle_t, (account)(level)(sum_deal)(sum_fee)(sum_deal_count)
-    (sum_arbit_count)(sum_deal_time)(sum_child_deal))
+    (sum_arbit_count)(sum_deal_time)(sum_child_deal)(creator))
+};
+/**
+ * closed deal waiting for settlement, appended by otcbook in async settle mode and drained by settle::drain
+ * scope: otcbook contract
+ */
+struct [[eosio::table("settleq"), eosio::contract("otcbook")]] settle_queue_t {
+    uint64_t    id;
+    uint64_t    deal_id;
+    name        merchant;
+    name        user;
+    int64_t     quantity    = 0;            //amount of CASH_SYMBOL
+    int64_t     fee         = 0;            //amount of CASH_SYMBOL
+    uint32_t    deal_time   = 0;            //seconds from created to closed
+
+    settle_queue_t() {}
+    settle_queue_t(const uint64_t& pid): id(pid) {}
+
+    uint64_t primary_key() const { return id; }
+
+    typedef eosio::multi_index <"settleq"_n, settle_queue_t> idx_t;
+
+    EOSLIB_SERIALIZE( settle_queue_t, (id)(deal_id)(merchant)(user)(quantity)(fee)(deal_time) )
+};
+
+/**
+ * next queue id of otcbook to be drained, one row for each fiat contract
+ */
+struct SETTLE_TBL_NAME("cursors") settle_cursor_t {
+    name        contract_name;
+    uint64_t    next_id = 0;
+
+    settle_cursor_t() {}
+    settle_cursor_t(const name& fait_contract): contract_name(fait_contract) {}
+
+    uint64_t primary_key() const { return contract_name.value; }
+
+    typedef eosio::multi_index <"cursors"_n, settle_cursor_t> idx_t;
+
+    EOSLIB_SERIALIZE( settle_cursor_t, (contract_name)(next_id) )
 };
+
 struct SETTLE_TBL reward_t {
     uint64_t        id;
     uint64_t        deal_id;
@@ -20,22 +20,67 @@ void settle::setconf(const name &conf_contract) {
     // _conf(true);
 }
 
-const fiat_conf_t settle::_conf(const name& fait_contract ,bool refresh/* = false*/) {
-    
+void settle::pubconf(const conf_digest_t& conf, const uint64_t& version) {
+    require_auth( _gstate.conf_contract );
+
+    _db.set(conf_digest_tbl_t(conf, version), _self);
+    _db.set(settle_conf_t(conf, version), _self);
+}
+
+/**
+ * conf digest pushed by conf contract is used if its version is current,
+ * otherwise digest the conf of conf contract and save it
+ */
+const conf_digest_t settle::_conf(const name& fait_contract ,bool refresh/* = false*/) {
     CHECK(_gstate.conf_contract.value != 0, "Invalid conf_table");
-    
-    fiat_conf_t::idx_t conf_tbl(_gstate.conf_contract,_gstate.conf_contract.value);
-    auto itr = conf_tbl.find( fait_contract.value );
-    CHECK( itr != conf_tbl.end(), "conf table not existed in contract: " + fait_contract.to_string());
-    // auto conf = conf_tbl.get( fait_contract.value );
-    // CHECKC(false, err::UN_INITIALIZE, "leveldd config hasn't set: " + to_string(conf.settle_levels.size()));
-    return conf_tbl.get( fait_contract.value );
+
+    auto version = read_conf_version(_gstate.conf_contract, fait_contract);
+    auto conf_digest = conf_digest_tbl_t(fait_contract);
+    if (!refresh && _db.get(conf_digest) && conf_digest.version.value_or(0) == version) return conf_digest.conf;
+
+    auto fiat_conf = fiat_conf_t( fait_contract );
+    CHECK( read_fiat_conf(_gstate.conf_contract, fiat_conf), "conf table not existed in contract: " + fait_contract.to_string());
+    conf_digest = conf_digest_tbl_t(conf_digest_t(fiat_conf), version);
+    _db.set(conf_digest, _self);
+    return conf_digest.conf;
+}
+
+/**
+ * settle conf kept locally if its version is current, otherwise digest it from the conf and save it
+ */
+settle_conf_t settle::_settle_conf(const name& fait_contract) {
+    CHECK(_gstate.conf_contract.value != 0, "Invalid conf_table");
+
+    auto version = read_conf_version(_gstate.conf_contract, fait_contract);
+    auto conf = settle_conf_t(fait_contract);
+    if (_db.get(conf) && conf.version == version) return conf;
+
+    conf = settle_conf_t(_conf(fait_contract), version);
+    _db.set(conf, _self);
+    return conf;
 }
 
+/**
+ * update the settle row of account with one lookup and one write
+ */
+template<typename Lambda>
+void settle::_update_settle(const name& account, Lambda&& updater) {
+    auto row = _db.find<settle_t>(account.value);
+    if (row.exists()) {
+        row.modify(same_payer, updater);
+        return;
+    }
+
+    CHECKC( is_account(account), err::ACCOUNT_INVALID, "invalid account: " + account.to_string() );
+    row.emplace(_self, [&](auto& s) {
+        s.account = account;
+        updater(s);
+    });
+}
 
 void settle::setlevel(const name& fait_contract,const name& user, uint8_t level){
     auto conf = _conf(fait_contract);
-    require_auth(conf.managers.at(otc::manager_type::admin));
+    require_auth(conf.manager(otc::manager_type::admin));
     CHECKC(level >=0, err::PARAM_ERROR, "level must be a positive number");
     CHECKC(level < conf.settle_levels.size(), err::PARAM_ERROR, "level must less than level: " + to_string(conf.settle_levels.size()-1));
     
@@ -54,58 +99,105 @@ void settle::deal(const name& fait_contract, const uint64_t& deal_id,
                   const time_point_sec& start_at, 
                   const time_point_sec& end_at){
     
-    fiat_conf_t conf = _conf(fait_contract);
-    require_auth(conf.managers.at(otc::manager_type::otcbook));
-    
-    CHECKC( is_account(merchant), err::ACCOUNT_INVALID, "invalid account: " + merchant.to_string() );
-    CHECKC( is_account(user), err::ACCOUNT_INVALID, "invalid account: " + user.to_string() );
+    const auto& conf = _settle_conf(fait_contract);
+    require_auth(conf.otcbook);
+
     CHECKC( quantity.amount > 0, err::INVALID_QUANTITY, "quantity must be positive" );
     CHECKC( fee.amount >= 0, err::INVALID_QUANTITY, "quantity must be positive" );
-    CHECKC( conf.settle_levels.size() > 0, err::SYSTEM_ERROR, "level config hasn't set: " );
+    CHECKC( conf.level_limits.size() > 0, err::SYSTEM_ERROR, "level config hasn't set: " );
     CHECKC( end_at > start_at, err::PARAM_ERROR, "end time should later than start time" );
     if( quantity.symbol != CASH_SYMBOL || fee.symbol != CASH_SYMBOL ) return;
 
-    auto user_settle_data = settle_t(user);
-    auto merchant_settle_data = settle_t(merchant);
-    _db.get(user_settle_data);
-    _db.get(merchant_settle_data);
-
     if(arbit_status != 0) {
-        user_settle_data.sum_arbit_count += 1;
-        merchant_settle_data.sum_arbit_count += 1;
-
-        _db.set(merchant_settle_data, _self);
-        _db.set(user_settle_data, _self);
+        _update_settle(merchant, [&](auto& s) { s.sum_arbit_count += 1; });
+        _update_settle(user, [&](auto& s) { s.sum_arbit_count += 1; });
         return;
     }
 
-    merchant_settle_data.sum_deal += quantity.amount;
-    merchant_settle_data.sum_fee += fee.amount;
-    merchant_settle_data.sum_deal_count += 1;
-    merchant_settle_data.sum_deal_time += (end_at - start_at).to_seconds();
+    auto deal_time = (end_at - start_at).to_seconds();
+    auto add_deal = [&](auto& s) {
+        s.sum_deal += quantity.amount;
+        s.sum_fee += fee.amount;
+        s.sum_deal_count += 1;
+        s.sum_deal_time += deal_time;
+    };
+    _update_settle(merchant, add_deal);
+
+    name creator;
+    _update_settle(user, [&](auto& s) {
+        add_deal(s);
+        if (!s.creator.has_value()) s.creator.emplace(get_account_creator(user));
+        creator = s.creator.value();
+    });
+    if (creator.value == 0) return;
 
-    user_settle_data.sum_deal += quantity.amount;
-    user_settle_data.sum_fee += fee.amount;
-    user_settle_data.sum_deal_count += 1;
-    user_settle_data.sum_deal_time += (end_at - start_at).to_seconds();
-
-    _db.set(merchant_settle_data, _self);
-    _db.set(user_settle_data, _self);
-    
     // only record user data for parent
-    auto creator = get_account_creator(user);
-    auto creator_data = settle_t(creator);
-    _db.get(creator_data);
-    creator_data.sum_child_deal += quantity.amount;
-    for(int j = conf.settle_levels.size(); j>0; j--){
-        auto config = conf.settle_levels.at(j-1);
-        if(creator_data.level >= j) break;
-        if(creator_data.sum_child_deal >= config.sum_limit){
-            creator_data.level = j-1;
-            break;
+    _add_child_deal(conf, creator, quantity.amount);
+}
+
+void settle::drain(const name& fait_contract, const uint32_t& max_rows) {
+    CHECKC( max_rows > 0, err::PARAM_ERROR, "max_rows must be positive" );
+    const auto& conf = _settle_conf(fait_contract);
+    CHECKC( conf.level_limits.size() > 0, err::SYSTEM_ERROR, "level config hasn't set: " );
+
+    struct settle_delta {
+        uint64_t sum_deal       = 0;
+        uint64_t sum_fee        = 0;
+        uint32_t sum_deal_count = 0;
+        uint32_t sum_deal_time  = 0;
+        uint64_t user_deal      = 0;    //deal as user, recorded for parent
+    };
+    map<name, settle_delta> deltas;
+
+    auto cursor = settle_cursor_t(fait_contract);
+    _db.get(cursor);
+
+    settle_queue_t::idx_t queue(conf.otcbook, conf.otcbook.value);
+    auto itr = queue.lower_bound(cursor.next_id);
+    CHECKC( itr != queue.end(), err::RECORD_NOT_FOUND, "no deal to settle" );
+    for (uint32_t count = 0; itr != queue.end() && count < max_rows; ++itr, ++count) {
+        for (const auto& account : { itr->merchant, itr->user }) {
+            auto& delta = deltas[account];
+            delta.sum_deal       += itr->quantity;
+            delta.sum_fee        += itr->fee;
+            delta.sum_deal_count += 1;
+            delta.sum_deal_time  += itr->deal_time;
         }
+        deltas[itr->user].user_deal += itr->quantity;
+        cursor.next_id = itr->id + 1;
     }
-    _db.set(creator_data, _self);
+
+    map<name, uint64_t> child_deals;
+    for (const auto& [account, delta] : deltas) {
+        _update_settle(account, [&](auto& s) {
+            s.sum_deal       += delta.sum_deal;
+            s.sum_fee        += delta.sum_fee;
+            s.sum_deal_count += delta.sum_deal_count;
+            s.sum_deal_time  += delta.sum_deal_time;
+            if (delta.user_deal == 0) return;
+
+            if (!s.creator.has_value()) s.creator.emplace(get_account_creator(account));
+            if (s.creator.value().value != 0) child_deals[s.creator.value()] += delta.user_deal;
+        });
+    }
+
+    for (const auto& [creator, quantity] : child_deals)
+        _add_child_deal(conf, creator, quantity);
+
+    _db.set(cursor, _self);
+}
+
+void settle::_add_child_deal(const settle_conf_t& conf, const name& creator, const uint64_t& quantity) {
+    _update_settle(creator, [&](auto& s) {
+        s.sum_child_deal += quantity;
+        for(int j = conf.level_limits.size(); j>0; j--){
+            if(s.level >= j) break;
+            if(s.sum_child_deal >= conf.level_limits.at(j-1)){
+                s.level = j-1;
+                break;
+            }
+        }
+    });
 }
 
 // void settle::claim(const name& fait_contract, const name& reciptian, vector<uint64_t> rewards){